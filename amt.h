@@ -0,0 +1,57 @@
+#ifndef _AMT_H
+#define _AMT_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Amounts of money and of production/consumption. By default these are
+// doubles, and round-off errors are patched up where they occur. When built
+// with FIXED_POINT, they are 64-bit integers counting millionths of a unit,
+// so money moves between agents exactly and the total is conserved. Prices
+// are always doubles; amounts of production are rounded down and the cost of
+// a trade is rounded up (but never beyond what the consumer has), so that no
+// trade is free and every round of trading terminates.
+
+#ifdef FIXED_POINT
+
+typedef int64_t amt_t;
+// a single agent's lifetime totals fit in an amt_t, but their sum over
+// millions of agents doesn't, so sums over agents are wider
+typedef __int128 amt_sum_t;
+#define AMT_SCALE 1000000.0
+#define AMT_MAX INT64_MAX
+#define TO_AMT(x) ((amt_t)floor((x) * AMT_SCALE))
+#define FROM_AMT(a) ((double)(a) / AMT_SCALE)
+// fixed-point amounts are exact, so there is no round-off to deal with
+#define CLAMP_ROUND_OFF(a)
+
+#else
+
+typedef double amt_t;
+typedef double amt_sum_t;
+#define AMT_MAX 1e9
+#define TO_AMT(x) (x)
+#define FROM_AMT(a) (a)
+#define CLAMP_ROUND_OFF(a) do { if ((a) < 0.000001) (a) = 0; } while (0)
+
+#endif
+
+// Works out how much of what is wanted can be bought with the money available
+// and from what is for sale, and what it will cost.
+static inline void get_trade(amt_t wanted, amt_t money, amt_t unsold, double price,
+                             amt_t* csmp, amt_t* cost) {
+	double units = FROM_AMT(wanted);
+	// how much will it cost?
+	if (units * price > FROM_AMT(money)) units = FROM_AMT(money) / price;
+	// limited by what the producer has to sell
+	if (FROM_AMT(unsold) < units) units = FROM_AMT(unsold);
+    *csmp = TO_AMT(units);
+#ifdef FIXED_POINT
+    *cost = (amt_t)ceil(FROM_AMT(*csmp) * price * AMT_SCALE);
+    if (*cost > money) *cost = money;
+#else
+    *cost = *csmp * price;
+#endif
+}
+
+#endif
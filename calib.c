@@ -0,0 +1,124 @@
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "utils.h"
+#include "dismal.h"
+#include "parts.h"
+#include "calib.h"
+
+// Runs a single pilot in a child process, so that every pilot starts from
+// a clean slate, and returns its results through shared memory.
+static void run_pilot(cfg_t* cfg, pilot_t* result) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        FAIL("Could not fork pilot with sample size %d\n", cfg->prdr_sample_size);
+    }
+    if (pid == 0) {
+        _cfg = *cfg;
+#ifdef _OPENMP
+        omp_set_num_threads(_cfg.num_threads);
+#endif
+        init();
+        double start_time = _get_current_time();
+        run_sim();
+        result->time = _get_current_time() - start_time;
+        stats_t st;
+        get_stats(_cfg.num_iters, SHOW_LIFETIME, &st);
+        result->price = st.price / _ags.num;
+        result->poverty = (double)st.num_in_poverty * 100.0 / _ags.num;
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        FAIL("Pilot with sample size %d failed\n", cfg->prdr_sample_size);
+    }
+}
+
+static void run_pilots(cfg_t* base_cfg, pilot_t* pilot) {
+    static pilot_t* result = NULL;
+    if (!result) result = alloc_shared(sizeof(pilot_t));
+    cfg_t cfg = *base_cfg;
+    cfg.prdr_sample_size = pilot->prdr_sample_size;
+    cfg.num_threads = pilot->num_threads;
+    cfg.clearing = pilot->clearing;
+    pilot->time = pilot->price = pilot->poverty = 0;
+    for (int s = 0; s < CALIB_NUM_SEEDS; s++) {
+        cfg.rseed = base_cfg->rseed + s;
+        run_pilot(&cfg, result);
+        pilot->time += result->time / CALIB_NUM_SEEDS;
+        pilot->price += result->price / CALIB_NUM_SEEDS;
+        pilot->poverty += result->poverty / CALIB_NUM_SEEDS;
+    }
+}
+
+static void print_pilot(pilot_t* pilot, int num_ags, int num_iters) {
+    mprintf(7, "%6d", pilot->prdr_sample_size, "%6d", pilot->num_threads,
+            "%6d", pilot->clearing, "%10.3f", pilot->price, "%8.1f", pilot->poverty,
+            "%8.3f", pilot->err,
+            "%12.3e\n", (double)num_ags * num_iters / pilot->time);
+}
+
+void calibrate(void) {
+    cfg_t base_cfg = _cfg;
+    base_cfg.num_iters = _cfg.calibrate;
+    base_cfg.verbose_flags = 0;
+    base_cfg.telemetry = NULL;
+    base_cfg.history_file = NULL;
+    base_cfg.mobility_bands = 0;
+    base_cfg.calibrate = 0;
+
+    printf("Calibrating with %d iterations per pilot, tolerance %.3f\n",
+           base_cfg.num_iters, _cfg.calib_tol);
+    mprintf(7, "%6s", "k", "%6s", "thrds", "%6s", "clear", "%10s", "price",
+            "%8s", "pvt", "%8s", "err", "%12s", "ags/s\n");
+
+    pilot_t ref = {.prdr_sample_size = CALIB_REF_SAMPLE_SIZE,
+                   .num_threads = _cfg.num_threads, .clearing = CLEARING_RANDOM};
+    run_pilots(&base_cfg, &ref);
+    print_pilot(&ref, base_cfg.num_ags, base_cfg.num_iters);
+
+    // threads are used in every mode, by the stats, the initialization and
+    // the shuffled clearing as well as by the goods, so they are always swept,
+    // but the clearing schedule only applies to the single-good, unpartitioned
+    // mode
+    int max_threads = _cfg.num_threads;
+    int max_clearing = (_cfg.num_goods || _cfg.num_parts) ? CLEARING_RANDOM : CLEARING_SHUFFLED;
+    const int sample_sizes[] = {1, 2, 3, 4, 6, 8, 12, 16, 24, 32};
+    int num_sample_sizes = sizeof(sample_sizes) / sizeof(int);
+
+    pilot_t best = ref;
+    for (int i = 0; i < num_sample_sizes; i++) {
+        for (int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+            for (int clearing = CLEARING_RANDOM; clearing <= max_clearing; clearing++) {
+                pilot_t pilot = {.prdr_sample_size = sample_sizes[i],
+                                 .num_threads = num_threads, .clearing = clearing};
+                run_pilots(&base_cfg, &pilot);
+                pilot.err = fabs(pilot.price - ref.price) / ref.price +
+                    fabs(pilot.poverty - ref.poverty) / 100.0;
+                print_pilot(&pilot, base_cfg.num_ags, base_cfg.num_iters);
+                if (pilot.err <= _cfg.calib_tol && pilot.time < best.time) best = pilot;
+            }
+        }
+    }
+
+    cfg_t cfg = _cfg;
+    cfg.prdr_sample_size = best.prdr_sample_size;
+    cfg.num_threads = best.num_threads;
+    cfg.clearing = best.clearing;
+    cfg.calibrate = 0;
+    printf("Best: sample size %d, threads %d, clearing %d, written to %s\n",
+           cfg.prdr_sample_size, cfg.num_threads, cfg.clearing, CALIB_FILE);
+    FILE* f = fopen(CALIB_FILE, "w");
+    if (!f) {
+        FAIL("Could not open %s\n", CALIB_FILE);
+    }
+    print_cfg_args(&cfg, f);
+    fclose(f);
+}
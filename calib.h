@@ -0,0 +1,30 @@
+#ifndef _CALIB_H
+#define _CALIB_H
+
+// Calibration: runs short pilot simulations across prdr_sample_size and the
+// thread and clearing settings, and compares their equilibrium price and
+// poverty rate to a reference run with a large sample size. The configuration
+// with the highest throughput whose deviation from the reference is within
+// the tolerance is written out as command line options to CALIB_FILE.
+
+#define CALIB_FILE "calibrated.cfg"
+// sample size of the reference run
+#define CALIB_REF_SAMPLE_SIZE 64
+// each pilot is averaged over this many seeds
+#define CALIB_NUM_SEEDS 3
+
+typedef struct {
+    int prdr_sample_size;
+    int num_threads;
+    int clearing;
+    // averages over the seeds
+    double time;
+    double price;
+    double poverty;
+    // deviation from the reference
+    double err;
+} pilot_t;
+
+void calibrate(void);
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "utils.h"
 #include "cfg.h"
 
 static struct option lopts[] = {
@@ -11,6 +12,21 @@ static struct option lopts[] = {
     {"av_max_csmp", 1, 0, 'c'},
     {"av_max_prod", 1, 0, 'p'},
     {"prdr_sample_size", 1, 0, 'z'},
+    {"shocks_file", 1, 0, 's'},
+    {"num_goods", 1, 0, 'g'},
+    {"goods_per_ag", 1, 0, 'k'},
+    {"num_threads", 1, 0, 't'},
+    {"telemetry", 1, 0, 'm'},
+    {"clearing", 1, 0, 'r'},
+    {"num_parts", 1, 0, 'P'},
+    {"fork_parts", 1, 0, 'F'},
+    {"calibrate", 1, 0, 'C'},
+    {"calib_tol", 1, 0, 'E'},
+    {"history_file", 1, 0, 'H'},
+    {"history_window", 1, 0, 'W'},
+    {"history_bits", 1, 0, 'B'},
+    {"huge_pages", 1, 0, 'U'},
+    {"mobility_bands", 1, 0, 'M'},
     {"verbose_flags", 1, 0, 'v'},
     {"help", 0, 0, 'h'},
     {0, 0, 0, 0}
@@ -24,6 +40,21 @@ const char* opts_help[] = {
     "max. consumption",
     "max. production",
     "sample size for getting cheapest producer",
+    "file with the timeline of shocks",
+    "number of goods (0 for a single-good economy)",
+    "goods produced and consumed per agent",
+    "number of threads",
+    "shared memory name for live telemetry",
+    "clearing: 0 random picks, 1 shuffled passes",
+    "number of agent partitions (0 for none)",
+    "run each partition in its own process (Linux only)",
+    "iterations per calibration pilot (0 for none)",
+    "tolerance for calibration error",
+    "file for compressed per-agent histories",
+    "iterations per history chunk",
+    "mantissa bits kept in histories (52 lossless, less is lossy)",
+    "use huge pages for the agents",
+    "wealth bands for mobility reports (0 for none)",
     "verbose-mode flags",
     "this help"};
 
@@ -44,6 +75,21 @@ void load_cfg(int argc, char** argv, cfg_t* cfg) {
     cfg->av_max_csmp = 10.0;
     cfg->av_max_prod = 10.0;
     cfg->prdr_sample_size = 10;
+    cfg->shocks_file = NULL;
+    cfg->num_goods = 0;
+    cfg->goods_per_ag = 4;
+    cfg->num_threads = 1;
+    cfg->telemetry = NULL;
+    cfg->clearing = CLEARING_RANDOM;
+    cfg->num_parts = 0;
+    cfg->fork_parts = 0;
+    cfg->calibrate = 0;
+    cfg->calib_tol = 0.05;
+    cfg->history_file = NULL;
+    cfg->history_window = 32;
+    cfg->history_bits = 52;
+    cfg->huge_pages = 0;
+    cfg->mobility_bands = 0;
     cfg->verbose_flags = VFLAG_STATS;
     char verbose_str[5000] = "";
     // get cfgs
@@ -64,6 +110,21 @@ void load_cfg(int argc, char** argv, cfg_t* cfg) {
         case 'c': cfg->av_max_csmp = atof(optarg); break;
         case 'p': cfg->av_max_prod = atof(optarg); break;
         case 'z': cfg->prdr_sample_size = atoi(optarg); break;
+        case 's': cfg->shocks_file = optarg; break;
+        case 'g': cfg->num_goods = atoi(optarg); break;
+        case 'k': cfg->goods_per_ag = atoi(optarg); break;
+        case 't': cfg->num_threads = atoi(optarg); break;
+        case 'm': cfg->telemetry = optarg; break;
+        case 'r': cfg->clearing = atoi(optarg); break;
+        case 'P': cfg->num_parts = atoi(optarg); break;
+        case 'F': cfg->fork_parts = atoi(optarg); break;
+        case 'C': cfg->calibrate = atoi(optarg); break;
+        case 'E': cfg->calib_tol = atof(optarg); break;
+        case 'H': cfg->history_file = optarg; break;
+        case 'W': cfg->history_window = atoi(optarg); break;
+        case 'B': cfg->history_bits = atoi(optarg); break;
+        case 'U': cfg->huge_pages = atoi(optarg); break;
+        case 'M': cfg->mobility_bands = atoi(optarg); break;
         case 'v': 
             for (int i = 0; i < strlen(optarg); i++) {
                 for (int v = 0; v < vflags_len; v++) {
@@ -95,6 +156,11 @@ void load_cfg(int argc, char** argv, cfg_t* cfg) {
         }
         exit(EXIT_FAILURE);
     }
+    // the bands are kept in a byte per agent
+    if (cfg->mobility_bands < 0 || cfg->mobility_bands > 255) {
+        FAIL("Mobility bands must be from 1 to 255, or 0 for none, not %d\n",
+             cfg->mobility_bands);
+    }
     print_cfg(cfg, ' ', stdout);
     fprintf(stdout, "%c  -v%s\n", ' ', verbose_str);
 }
@@ -103,6 +169,11 @@ void load_cfg(int argc, char** argv, cfg_t* cfg) {
     fprintf(f, "%c  -%c %-50s %8d\n", comment, lopts[i].val, opts_help[i], opt); \
     i++; 
 
+#define PRINT_STR_OPT(opt)                                              \
+    fprintf(f, "%c  -%c %-50s %8s\n", comment, lopts[i].val, opts_help[i], \
+            opt ? opt : "none");                                        \
+    i++; 
+
 #define PRINT_DOUBLE_OPT(opt)                                              \
     fprintf(f, "%c  -%c %-50s %8.2f\n", comment, lopts[i].val, opts_help[i], opt); \
     i++; 
@@ -115,7 +186,54 @@ void print_cfg(cfg_t* cfg, char comment, FILE* f) {
     PRINT_DOUBLE_OPT(cfg->av_max_csmp);
     PRINT_DOUBLE_OPT(cfg->av_max_prod);
     PRINT_INT_OPT(cfg->prdr_sample_size);
+    PRINT_STR_OPT(cfg->shocks_file);
+    PRINT_INT_OPT(cfg->num_goods);
+    PRINT_INT_OPT(cfg->goods_per_ag);
+    PRINT_INT_OPT(cfg->num_threads);
+    PRINT_STR_OPT(cfg->telemetry);
+    PRINT_INT_OPT(cfg->clearing);
+    PRINT_INT_OPT(cfg->num_parts);
+    PRINT_INT_OPT(cfg->fork_parts);
+    PRINT_INT_OPT(cfg->calibrate);
+    PRINT_DOUBLE_OPT(cfg->calib_tol);
+    PRINT_STR_OPT(cfg->history_file);
+    PRINT_INT_OPT(cfg->history_window);
+    PRINT_INT_OPT(cfg->history_bits);
+    PRINT_INT_OPT(cfg->huge_pages);
+    PRINT_INT_OPT(cfg->mobility_bands);
 }
 
 
 
+
+#define ARG_INT_OPT(opt)                                                \
+    fprintf(f, " -%c %d", lopts[i].val, opt);                           \
+    i++; 
+
+#define ARG_STR_OPT(opt)                                                \
+    if (opt) fprintf(f, " -%c %s", lopts[i].val, opt);                  \
+    i++; 
+
+#define ARG_DOUBLE_OPT(opt)                                             \
+    fprintf(f, " -%c %g", lopts[i].val, opt);                           \
+    i++; 
+
+// prints the cfg as command line options, so it can be reused for a run
+void print_cfg_args(cfg_t* cfg, FILE* f) {
+    int i = 0;
+    ARG_INT_OPT(cfg->rseed);
+    ARG_INT_OPT(cfg->num_iters);
+    ARG_INT_OPT(cfg->num_ags);
+    ARG_DOUBLE_OPT(cfg->av_max_csmp);
+    ARG_DOUBLE_OPT(cfg->av_max_prod);
+    ARG_INT_OPT(cfg->prdr_sample_size);
+    ARG_STR_OPT(cfg->shocks_file);
+    ARG_INT_OPT(cfg->num_goods);
+    ARG_INT_OPT(cfg->goods_per_ag);
+    ARG_INT_OPT(cfg->num_threads);
+    ARG_STR_OPT(cfg->telemetry);
+    ARG_INT_OPT(cfg->clearing);
+    ARG_INT_OPT(cfg->num_parts);
+    ARG_INT_OPT(cfg->fork_parts);
+    fprintf(f, "\n");
+}
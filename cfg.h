@@ -16,6 +16,8 @@ typedef struct {
 #define VFLAG_CONSUME 8
 #define VFLAG_CONSUME_DETAILS 16
 #define VFLAG_STATS 32
+#define VFLAG_SHOCKS 64
+#define VFLAG_PRECISE 128
 
 static const verbose_flag_t VERBOSE_FLAGS[] = {
     {.index = VFLAG_TIMERS, .flag = 'T', .name = "timers"},
@@ -24,6 +26,8 @@ static const verbose_flag_t VERBOSE_FLAGS[] = {
     {.index = VFLAG_CONSUME, .flag = 'C', .name = "consume"},
     {.index = VFLAG_CONSUME_DETAILS, .flag = 'D', .name = "consume details"},
     {.index = VFLAG_STATS, .flag = 'S', .name = "show stats every iter"},
+    {.index = VFLAG_SHOCKS, .flag = 'K', .name = "shocks"},
+    {.index = VFLAG_PRECISE, .flag = 'P', .name = "precise lifetime stats"},
 };
 
 #define DBG(FLAG, fmt, ...)                                             \
@@ -34,6 +38,9 @@ static const verbose_flag_t VERBOSE_FLAGS[] = {
 
 #define DBG_START(FLAG) if (_cfg.verbose_flags & FLAG) 
 
+#define CLEARING_RANDOM 0
+#define CLEARING_SHUFFLED 1
+
 typedef struct {
 	int rseed;
     int num_iters;
@@ -41,11 +48,27 @@ typedef struct {
     double av_max_csmp;
     double av_max_prod;
     int prdr_sample_size;
+    char* shocks_file;
+    int num_goods;
+    int goods_per_ag;
+    int num_threads;
+    char* telemetry;
+    int clearing;
+    int num_parts;
+    int fork_parts;
+    int calibrate;
+    double calib_tol;
+    char* history_file;
+    int history_window;
+    int history_bits;
+    int huge_pages;
+    int mobility_bands;
     int verbose_flags;    
 } cfg_t;
 
 void load_cfg(int argc, char** argv, cfg_t* cfg);
 void print_cfg(cfg_t* cfg, char comment, FILE* f);
+void print_cfg_args(cfg_t* cfg, FILE* f);
 
 #endif
 
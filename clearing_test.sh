@@ -0,0 +1,97 @@
+#!/bin/bash
+# Compares the two clearing schedules statistically: runs dismal over a range
+# of seeds with --clearing 0 (random picks) and --clearing 1 (shuffled), and
+# checks that the lifetime average price, consumption and poverty rate come
+# from the same distribution, with a two-sample Kolmogorov-Smirnov test at 5%
+# and a check that the 95% confidence intervals of the means overlap. The
+# values are taken at full precision, from the lines printed with -v P.
+#
+# To show that the test can tell distributions apart, random picks are also
+# compared with random picks under a change that is expected to matter
+# (POWER_OPTS, a smaller producer sample by default), which must fail.
+#
+# Usage: clearing_test.sh [num seeds] [dismal options...]
+# e.g. clearing_test.sh 30 -n 10000 -i 2000
+
+NUM_SEEDS=${1:-20}
+shift
+OPTS=${@:--n 10000 -i 1000}
+DISMAL=${DISMAL:-./dismal}
+POWER_OPTS=${POWER_OPTS:--z 5}
+
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+
+# runs all the seeds with the given options, one line of metrics per seed
+run_seeds() {
+    local out=$1
+    shift
+    for seed in $(seq 1 $NUM_SEEDS); do
+        $DISMAL $OPTS "$@" -d $seed -v P | \
+            awk '/^ PRECISE/ { print $4, $7, $9; exit }'
+    done > $TMP/$out.dat
+}
+
+# compares each metric between two sets of runs; returns non-zero if any of
+# them differ
+compare() {
+    local label_a=$1 label_b=$2 differ=0 col=1
+    for name in price consumption poverty; do
+        cut -d' ' -f$col $TMP/$label_a.dat | sort -g > $TMP/a
+        cut -d' ' -f$col $TMP/$label_b.dat | sort -g > $TMP/b
+        awk -v name=$name -v label_a=$label_a -v label_b=$label_b '
+            FNR == NR { a[n++] = $1; next }
+            { b[m++] = $1 }
+            function mean_ci(x, k,    i, s, ss, mu) {
+                for (i = 0; i < k; i++) s += x[i]
+                mu = s / k
+                for (i = 0; i < k; i++) ss += (x[i] - mu) ^ 2
+                _ci = k > 1 ? 1.96 * sqrt(ss / (k - 1) / k) : 0
+                return mu
+            }
+            END {
+                mu_a = mean_ci(a, n); ci_a = _ci
+                mu_b = mean_ci(b, m); ci_b = _ci
+                # both samples are sorted, so the largest gap between the
+                # empirical distributions is found in a single merge
+                i = j = 0; d = 0
+                while (i < n && j < m) {
+                    x = a[i] <= b[j] ? a[i] : b[j]
+                    while (i < n && a[i] <= x) i++
+                    while (j < m && b[j] <= x) j++
+                    g = i / n - j / m
+                    if (g < 0) g = -g
+                    if (g > d) d = g
+                }
+                d_crit = 1.36 * sqrt((n + m) / (n * m))
+                overlap = mu_a - ci_a <= mu_b + ci_b && mu_b - ci_b <= mu_a + ci_a
+                same = d <= d_crit && overlap
+                printf("  %-12s %s %.6f +- %.6f  %s %.6f +- %.6f  KS D %.3f (crit %.3f)  %s\n",
+                       name, label_a, mu_a, ci_a, label_b, mu_b, ci_b, d, d_crit,
+                       same ? "same" : "differ")
+                exit !same
+            }' $TMP/a $TMP/b || differ=1
+        col=$((col + 1))
+    done
+    return $differ
+}
+
+run_seeds random -r 0 &
+run_seeds shuffled -r 1 &
+run_seeds power -r 0 $POWER_OPTS &
+wait
+for out in random shuffled power; do
+    if [ $(wc -l < $TMP/$out.dat) -ne $NUM_SEEDS ]; then
+        echo "Runs for $out failed"
+        exit 1
+    fi
+done
+
+FAILED=0
+echo "random picks vs shuffled passes, expected to be the same:"
+if compare random shuffled; then echo "PASS"; else echo "FAIL"; FAILED=1; fi
+echo "random picks vs random picks with $POWER_OPTS, expected to differ:"
+if compare random power; then echo "FAIL: the test could not tell them apart"; FAILED=1
+else echo "PASS"; fi
+
+exit $FAILED
@@ -41,7 +41,9 @@
     or remove money from the system. This will be like the Treasury printing
     more money. The trick will be figuring out *how* that money will get into
     the system. What we should really be doing is providing it to agents as a
-    loan with interest.
+    loan with interest. For now, money injections and removals, along with
+    shocks to consumption and production capacity and changes to the price
+    adjustment regime, can be scheduled with a timeline file (see shocks.h).
 
     Tax system: the government collects a certain fraction of earnings as
     taxes. This could be a flat tax or a progressive tax, whatever we wish. The
@@ -75,40 +77,26 @@
 #include <math.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "utils.h"
 #include "cfg.h"
+#include "shocks.h"
+#include "goods.h"
+#include "telemetry.h"
+#include "parts.h"
+#include "calib.h"
+#include "history.h"
+#include "mobility.h"
+#include "dismal.h"
 
 static FILE* _update_file;
-static cfg_t _cfg;
+cfg_t _cfg;
+static shocks_t _shocks;
 
-// units of production and consumption are integers because they cannot be
-// divided too finely 
-typedef struct {
-    int id;
-    // these are all fixed for the life of the agent 
-    double max_csmp;
-    double max_prod;
-
-    // these fluctuate from one round to the next
-    double money;
-	// how much money has been gained in this round
-	double money_gained;
-	// how much production is still unsold
-    double unsold_prod;
-    double csmp;
-    // total consumption over this agent's lifetime
-    double tot_csmp;
-    // total production over the lifetime of this agent
-    double tot_prod;
-    double prod_price;
-	// how much adjustment will this agent do to correct price issues?
-	double price_adjust;
-} ag_t;
-
-struct {
-    ag_t* _;
-    int num;
-} _ags;
+ags_t _ags;
 
 struct {
     int* _;
@@ -120,20 +108,31 @@ struct {
     int num;
 } _csmrs;
 
-static int _iters = 0;
+int _iters = 0;
+// number of trades in the current round
+static long _num_trades = 0;
+// money added to (or removed from) the system by shocks
+static amt_t _money_injected = 0;
+// money in the system at the start
+static amt_t _money_initial = 0;
 
 #define AG_PTR(ag_i) get_ag_ptr(ag_i, __LINE__)
 
-#define SHOW_ROUND 0
-#define SHOW_LIFETIME 1
+// agents initialized in each block, which jumps to its own place in the
+// main random stream (with glibc only)
+#define INIT_BLOCK_SIZE 65536
 
 ag_t* get_ag_ptr(int ag_i, int line_num);
-void init();
 void update_ag(ag_t* ag);
-void compute_price(ag_t* ag);
+void apply_shock(shock_t* shock);
 int find_cheapest_prdr(int csmr_i);
+amt_t trade(ag_t* csmr, ag_t* prdr);
 void consume(int csmr_i, int prdr_i);
+void clear_shuffled(void);
 void compute_stats(int t, int show_what);
+void clear_stats(stats_t* st);
+void add_ag_stats(stats_t* st, ag_t* ag, int t, int show_what);
+void merge_stats(stats_t* st, stats_t* other);
 void print_ags(void);
 void print_ag(ag_t* ag);
 
@@ -155,6 +154,13 @@ int main(int argc, char** argv) {
     printf("DISMAL ECONOMIC MODEL (Version %.2f) compiled %s\n", 
            EMPLOY_VERSION, __DATE__);
     load_cfg(argc, argv, &_cfg);
+    if (_cfg.calibrate) {
+        calibrate();
+        return 0;
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(_cfg.num_threads);
+#endif
     _update_file = fopen("updates.dat", "w");
     print_cfg(&_cfg, '#', _update_file);
 
@@ -167,33 +173,111 @@ int main(int argc, char** argv) {
             "%7s", "av P", "%7s", "mx P", "%7s", "mn P", 
             "%7s", "pvt\n");
 
+    timer_start(MAIN_TIMER);
+    run_sim();
+    compute_stats(_iters, SHOW_LIFETIME);
+	timer_stop(MAIN_TIMER);
+	printf("Time taken %.2f\n", timer_read(MAIN_TIMER));
+
+    fclose(_update_file);
+}
+
+// publishes the aggregates for the current iteration, which are the same as
+// the per-round stats
+static void publish_telemetry(double clear_time, double iter_time) {
+    stats_t st;
+    get_stats(_iters + 1, SHOW_ROUND, &st);
+    tl_rec_t rec = {
+        .iter = _iters,
+        .av_money = FROM_AMT(st.money), .max_money = FROM_AMT(st.max_money),
+        .min_money = FROM_AMT(st.min_money),
+        .av_price = st.price, .max_price = st.max_price, .min_price = st.min_price,
+        .av_csmp = FROM_AMT(st.csmp), .max_csmp = FROM_AMT(st.max_csmp),
+        .min_csmp = FROM_AMT(st.min_csmp),
+        .av_prod = FROM_AMT(st.prod), .max_prod = FROM_AMT(st.max_prod),
+        .min_prod = FROM_AMT(st.min_prod),
+        .num_in_poverty = st.num_in_poverty,
+        .num_trades = _num_trades,
+        .clear_time = clear_time,
+        .iter_time = iter_time,
+    };
+    tl_publish(&rec);
+}
+
+// runs all the iterations of the simulation
+void run_sim(void) {
 	int iter_step = _cfg.num_iters / 25;
+	if (iter_step < 1) iter_step = 1;
+
+    if (_cfg.telemetry) tl_open(_cfg.telemetry, _ags.num, _cfg.num_iters);
+    double last_publish_time = 0;
+
+    if (_cfg.history_file) hist_open(_cfg.history_file, _ags.num, _cfg.history_window,
+                                        _cfg.history_bits);
+
+    if (_cfg.num_parts) start_parts();
 
-    timer_start(MAIN_TIMER);
     for (_iters = 0; _iters < _cfg.num_iters; _iters++) {
+        // the timing is only needed for the telemetry
+        double iter_start_time = 0;
+        double clear_time = 0;
+        if (_cfg.telemetry) iter_start_time = _get_current_time();
         _prdrs.num = 0;
         _csmrs.num = 0;
+        _num_trades = 0;
+
+        // apply any shocks scheduled for this iteration. The timeline is
+        // sorted, so this is a single check when there is nothing to do
+        while (_shocks.next < _shocks.num && _shocks._[_shocks.next].iter == _iters) {
+            apply_shock(&_shocks._[_shocks.next++]);
+        }
 
-        // update the agents and setup the lists of producers and consumers
-        for (int i = 0; i < _ags.num; i++) update_ag(AG_PTR(i));
-
-        int sample = 0;
-        // now try to match consumers with producers
-        while (_csmrs.num && _prdrs.num) {
-            // a randomly selected consumer consumes what is produced by the
-            // cheapest producer in a sample
-            int csmr_i = get_int_rnd(_csmrs.num);
-			int prdr_i = find_cheapest_prdr(csmr_i);
-			if (prdr_i != -1) consume(csmr_i, prdr_i);
-			else {
-				// we could not get a valid prdr, so we check for this agent
-				// being the only one left in both csmrs and prdrs
-				if (_prdrs.num == 1 && _csmrs.num == 1 && _prdrs._[0] == _csmrs._[0]) break;
-			}
+        if (_cfg.num_goods) {
+            // each good has its own market, and prices are set per good
+            _num_trades = clear_goods();
+            if (_cfg.telemetry) clear_time = _get_current_time() - iter_start_time;
+        } else if (_cfg.num_parts) {
+            // each partition's agents are updated, traded and priced by their
+            // own worker
+            _num_trades = clear_parts();
+            if (_cfg.telemetry) clear_time = _get_current_time() - iter_start_time;
+        } else {
+            // update the agents and setup the lists of producers and consumers
+            for (int i = 0; i < _ags.num; i++) update_ag(AG_PTR(i));
+
+            // now try to match consumers with producers
+            if (_cfg.clearing == CLEARING_SHUFFLED) clear_shuffled();
+            while (_csmrs.num && _prdrs.num) {
+                // a randomly selected consumer consumes what is produced by the
+                // cheapest producer in a sample
+                int csmr_i = get_int_rnd(_csmrs.num);
+                int prdr_i = find_cheapest_prdr(csmr_i);
+                if (prdr_i != -1) consume(csmr_i, prdr_i);
+                else {
+                    // we could not get a valid prdr, so we check for this agent
+                    // being the only one left in both csmrs and prdrs
+                    if (_prdrs.num == 1 && _csmrs.num == 1 && _prdrs._[0] == _csmrs._[0]) break;
+                }
+            }
+
+            if (_cfg.telemetry) clear_time = _get_current_time() - iter_start_time;
+            // compute new prices, updating the poverty spells in the same sweep
+            for (int i = 0; i < _ags.num; i++) {
+                ag_t* ag = AG_PTR(i);
+                compute_price(ag);
+                update_pvt_spell(ag);
+            }
         }
 
-        // compute new prices
-        for (int i = 0; i < _ags.num; i++) compute_price(AG_PTR(i));
+        if (_cfg.telemetry) {
+            double now = _get_current_time();
+            if (now - last_publish_time >= TL_PUBLISH_SECS || _iters == _cfg.num_iters - 1) {
+                publish_telemetry(clear_time, now - iter_start_time);
+                last_publish_time = _get_current_time();
+            }
+        }
+
+        if (_cfg.history_file) hist_record(_iters, _ags._);
 
         DBG_START(VFLAG_AGENTS) {
             print_ags();
@@ -202,44 +286,94 @@ int main(int argc, char** argv) {
 
         DBG_START(VFLAG_STATS) {
             // compute and print out statistics
-            if (_iters % iter_step == 0) compute_stats(_iters + 1, SHOW_ROUND);
+            if (_iters % iter_step == 0) {
+                compute_stats(_iters + 1, SHOW_ROUND);
+                if (_cfg.mobility_bands) report_mobility(_iters + 1);
+            }
         }
     }
-    compute_stats(_iters, SHOW_LIFETIME);
-	timer_stop(MAIN_TIMER);
-	printf("Time taken %.2f\n", timer_read(MAIN_TIMER));
+    if (_cfg.num_parts) stop_parts();
+    if (_cfg.telemetry) tl_close();
+    if (_cfg.history_file) hist_close();
+}
 
-    fclose(_update_file);
+// sets up an agent, drawing its random values from seed
+static void init_ag(ag_t* ag, int id, unsigned int* seed) {
+    ag->id = id;
+    // this is variable, based on individual choice
+    double min_csmp = _cfg.av_max_csmp * 0.5;
+    if (min_csmp < 1) min_csmp = 1;
+    ag->max_csmp = TO_AMT(get_double_rnd_r(min_csmp, _cfg.av_max_csmp, seed));
+    //ag->max_csmp = _cfg.av_max_csmp;
+    // this is fixed, based on common ability
+    ag->max_prod = TO_AMT(_cfg.av_max_prod);
+    ag->unsold_prod = TO_AMT(1.0);
+    // always start with 1 money unit
+    ag->money = TO_AMT(1.0);
+    // start off by charging what we believe to be the minimum
+    ag->prod_price = FROM_AMT(ag->money);
+    ag->price_adjust = 0.001;//get_double_rnd(0.001, 0.01);
 }
 
 void init() {
 	init_rnd(_cfg.rseed);
 
     _ags.num = _cfg.num_ags;
-    _ags._ = calloc(_cfg.num_ags, sizeof(ag_t));
+    // forked partitions all work on the same agents
+    int shared = _cfg.num_parts && _cfg.fork_parts;
+    if (_cfg.huge_pages) {
+        _ags._ = alloc_huge(_cfg.num_ags * sizeof(ag_t), shared);
+    } else if (shared) {
+        _ags._ = alloc_shared(_cfg.num_ags * sizeof(ag_t));
+    } else {
+        _ags._ = calloc(_cfg.num_ags, sizeof(ag_t));
+    }
     _prdrs._ = calloc(_cfg.num_ags, sizeof(int));
     _csmrs._ = calloc(_cfg.num_ags, sizeof(int));
 
-    for(int i = 0; i < _ags.num; i++) {
-        ag_t* ag = AG_PTR(i);
-        ag->id = i;
-		// this is variable, based on individual choice
-		double min_csmp = _cfg.av_max_csmp * 0.5;
-		if (min_csmp < 1) min_csmp = 1;
-		ag->max_csmp = get_double_rnd(min_csmp, _cfg.av_max_csmp);
-		//ag->max_csmp = _cfg.av_max_csmp;
-		// this is fixed, based on common ability
-        ag->max_prod = _cfg.av_max_prod;
-        ag->unsold_prod = 1.0;
-        ag->tot_prod = 0;
-        ag->tot_csmp = 0;
-		// always start with 1 money unit
-		ag->money = 1.0;
-		ag->money_gained = 0.0;
-		// start off by charging what we believe to be the minimum
-		ag->prod_price = ag->money;
-		ag->price_adjust = 0.001;//get_double_rnd(0.001, 0.01);
+    if (_cfg.num_goods && _cfg.num_parts) {
+        FAIL("Multiple goods and partitions cannot be used together: %d, %d\n",
+             _cfg.num_goods, _cfg.num_parts);
+    }
+    if (_cfg.clearing == CLEARING_SHUFFLED && (_cfg.num_goods || _cfg.num_parts)) {
+        FAIL("Shuffled clearing cannot be used with multiple goods or partitions: %d, %d\n",
+             _cfg.num_goods, _cfg.num_parts);
     }
+    if (_cfg.num_parts) init_parts();
+    if (_cfg.mobility_bands) init_mobility();
+
+    if (_cfg.shocks_file) {
+        load_shocks(_cfg.shocks_file, &_shocks);
+        DBG_START(VFLAG_SHOCKS) {
+            for (int i = 0; i < _shocks.num; i++) print_shock(&_shocks._[i], stdout);
+        }
+    }
+
+    // The totals and money_gained are left as the zeros from the allocation.
+    unsigned int init_seed = swap_rnd_seed(0);
+#ifdef __GLIBC__
+    // The agents are initialized in blocks, in parallel, each block starting
+    // from where the main random stream would be after the draws for the
+    // agents before it, so the results are the same as drawing them all in
+    // turn, for any number of threads.
+    int num_blocks = (_ags.num + INIT_BLOCK_SIZE - 1) / INIT_BLOCK_SIZE;
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < num_blocks; b++) {
+        unsigned int seed = skip_rnd_seed(init_seed, (unsigned long)b * INIT_BLOCK_SIZE);
+        int last = (b + 1) * INIT_BLOCK_SIZE < _ags.num ? (b + 1) * INIT_BLOCK_SIZE : _ags.num;
+        for (int i = b * INIT_BLOCK_SIZE; i < last; i++) init_ag(&_ags._[i], i, &seed);
+    }
+    // the main stream carries on after the draws for all the agents
+    init_rnd(skip_rnd_seed(init_seed, _ags.num));
+#else
+    // the main stream can only be jumped ahead with glibc's rand_r, so
+    // elsewhere the agents are drawn in turn
+    for (int i = 0; i < _ags.num; i++) init_ag(&_ags._[i], i, &init_seed);
+    init_rnd(init_seed);
+#endif
+    _money_initial = _ags.num * TO_AMT(1.0);
+    // the goods start from the agents' prices, so they are set up last
+    if (_cfg.num_goods) init_goods();
 }
 
 void update_ag(ag_t* ag) {
@@ -256,16 +390,55 @@ void update_ag(ag_t* ag) {
 	ag->money_gained = 0;
 }
 
+void apply_shock(shock_t* shock) {
+    DBG_START(VFLAG_SHOCKS) print_shock(shock, stdout);
+    int first = shock->first_ag;
+    int last = shock->last_ag;
+    if (last == -1 || last > _ags.num) last = _ags.num;
+    if (first >= last) return;
+    double value = shock->value;
+    // the range is checked once up front, so these are plain sweeps over the
+    // agents, with no per-agent tests other than what the shock itself needs
+    ag_t* ags = _ags._;
+    switch (shock->type) {
+    case SHOCK_MONEY:
+        for (int i = first; i < last; i++) {
+            amt_t money = ags[i].money + TO_AMT(value);
+            // money can only be removed from those who have it
+            if (money < 0) money = 0;
+            _money_injected += money - ags[i].money;
+            ags[i].money = money;
+        }
+        break;
+    case SHOCK_CSMP:
+        for (int i = first; i < last; i++) {
+            ags[i].max_csmp = TO_AMT(FROM_AMT(ags[i].max_csmp) * value);
+        }
+        break;
+    case SHOCK_PROD:
+        for (int i = first; i < last; i++) {
+            ags[i].max_prod = TO_AMT(FROM_AMT(ags[i].max_prod) * value);
+        }
+        break;
+    case SHOCK_PRICE_ADJUST:
+        for (int i = first; i < last; i++) ags[i].price_adjust = value;
+        break;
+    }
+}
+
 void compute_price(ag_t* ag) {
+    // a producer with no capacity has nothing to set a price for
+    if (ag->max_prod <= 0) return;
 	// we use our historical average to determine how to adjust the price
-	double exptd_prod = ag->tot_prod / (_iters + 1);
+	double exptd_prod = FROM_AMT(ag->tot_prod) / (_iters + 1);
+	double unsold_prod = FROM_AMT(ag->unsold_prod);
     // work out price for this producer based on previously expended production
 	//	double price_change = get_double_rnd(0, fabs(exptd_prod - ag->unsold_prod) / ag->max_prod) / 100.0;
-	double price_change = get_double_rnd(0, fabs(exptd_prod - ag->unsold_prod) / ag->max_prod) * ag->price_adjust;
+	double price_change = get_double_rnd(0, fabs(exptd_prod - unsold_prod) / FROM_AMT(ag->max_prod)) * ag->price_adjust;
 	//	double price_change = fabs(exptd_prod - ag->unsold_prod) / ag->max_prod	* ag->price_adjust;
 	//	double price_change = fabs(exptd_prod - ag->unsold_prod) / ag->max_prod / 100.0;
 	//price_change = ag->price_adjust;
-	if (exptd_prod < ag->unsold_prod) price_change *= -1.0;
+	if (exptd_prod < unsold_prod) price_change *= -1.0;
 	ag->prod_price += price_change;
     // the price should never fall to zero
 	double min_price = 0.00001;
@@ -281,6 +454,8 @@ int find_cheapest_prdr(int csmr_i) {
         int prdr_i = get_int_rnd(_prdrs.num);
         ag_t* prdr = AG_PTR(_prdrs._[prdr_i]);
         if (prdr->id == _csmrs._[csmr_i]) continue;
+        // only the shuffled clearing leaves sold out producers in the list
+        if (prdr->unsold_prod == 0) continue;
         if (prdr->prod_price < min_price) {
             min_price = prdr->prod_price;
             prdr_i_sel = prdr_i;
@@ -301,111 +476,306 @@ void consume(int csmr_i, int prdr_i) {
     // can't cosume your own production
     if (csmr->id == prdr->id) return;
 
+    amt_t csmp = trade(csmr, prdr);
+
+    if (prdr->unsold_prod == 0) {
+        // remove from list of producers
+        _prdrs._[prdr_i] = _prdrs._[--_prdrs.num];
+		DBG(VFLAG_CONSUME_DETAILS, "remove prdr %d\n", prdr->id);
+    }
+    // a consumer that can't afford even the smallest amount is also done
+    if (csmr->money == 0 || csmr->csmp >= csmr->max_csmp || csmp == 0) {
+        // remove from list of consumers
+        _csmrs._[csmr_i] = _csmrs._[--_csmrs.num];
+		DBG(VFLAG_CONSUME_DETAILS, "remove csmr %d\n", csmr->id);
+	} 
+}
+
+// the goods and money change hands between a consumer and a producer, and
+// the amount consumed is returned
+amt_t trade(ag_t* csmr, ag_t* prdr) {
     DBG(VFLAG_CONSUME_DETAILS, "csmr->id %d, csmr->money %.2f, csmr->csmp %.2f, "
         "prdr->id %d, prdr->unsold_prod %.2f\n",
-        csmr->id, csmr->money, csmr->csmp, prdr->id, prdr->unsold_prod);
+        csmr->id, FROM_AMT(csmr->money), FROM_AMT(csmr->csmp), prdr->id,
+        FROM_AMT(prdr->unsold_prod));
 
-	// how much consumption is left?
-	double csmp = csmr->max_csmp - csmr->csmp;
-	// how much will it cost?
-	double csmp_cost = csmp * prdr->prod_price;
-	if (csmp_cost > csmr->money) csmp = csmr->money / prdr->prod_price;
-	// limited by what the producer has to sell
-	if (prdr->unsold_prod < csmp) csmp = prdr->unsold_prod;
+	// how much consumption is left, and how much of that can we get?
+	amt_t csmp, csmp_cost;
+	get_trade(csmr->max_csmp - csmr->csmp, csmr->money, prdr->unsold_prod,
+			  prdr->prod_price, &csmp, &csmp_cost);
 
 	// now goods change hands
     prdr->unsold_prod -= csmp;
 	// deal with round off errors
-	if (prdr->unsold_prod < 0.000001) prdr->unsold_prod = 0;
+	CLAMP_ROUND_OFF(prdr->unsold_prod);
     prdr->tot_prod += csmp;
-	csmp_cost = csmp * prdr->prod_price;
-	if (csmr->money - csmp_cost < -0.00001) {
+	if (FROM_AMT(csmr->money - csmp_cost) < -0.00001) {
 		FAIL("csmr %d has less money %.2f than what is needed for consumption %.2f\n",
-			 csmr->id, csmr->money, csmp_cost);
+			 csmr->id, FROM_AMT(csmr->money), FROM_AMT(csmp_cost));
 	}
     prdr->money_gained += csmp_cost;
     csmr->money -= csmp_cost;
 	// deal with round off errors
-	if (csmr->money < 0.000001) csmr->money = 0;
+	CLAMP_ROUND_OFF(csmr->money);
     csmr->csmp += csmp;
     csmr->tot_csmp += csmp;
+    _num_trades++;
 
     DBG(VFLAG_CONSUME, "csmr %d, prdr %d, units %.2f, price %.2f\n", 
-        csmr->id, prdr->id, csmp, csmp_cost);
+        csmr->id, prdr->id, FROM_AMT(csmp), FROM_AMT(csmp_cost));
+    return csmp;
+}
 
-    if (prdr->unsold_prod == 0) {
-        // remove from list of producers
-        _prdrs._[prdr_i] = _prdrs._[--_prdrs.num];
-		DBG(VFLAG_CONSUME_DETAILS, "remove prdr %d\n", prdr->id);
+// how many consumers ahead to prefetch in the shuffled clearing
+#define CSMR_PREFETCH_DIST 8
+// consumers shuffled in each block before the blocks are merged
+#define SHUFFLE_BLOCK_SIZE 4096
+
+typedef struct {
+    unsigned int seed;
+    unsigned int bits;
+    int num_bits;
+} rnd_bits_t;
+
+// random bits are taken 30 at a time from a single draw
+static int get_rnd_bit(rnd_bits_t* rb) {
+    if (!rb->num_bits) {
+        rb->bits = rand_r(&rb->seed);
+        rb->num_bits = 30;
     }
-    if (csmr->money == 0 || csmr->csmp >= csmr->max_csmp) {
-        // remove from list of consumers
-        _csmrs._[csmr_i] = _csmrs._[--_csmrs.num];
-		DBG(VFLAG_CONSUME_DETAILS, "remove csmr %d\n", csmr->id);
-	} 
+    rb->num_bits--;
+    return (rb->bits >> rb->num_bits) & 1;
 }
 
-void set_av_max_min(double val, double *av, double *mx, double *mn) {
-    (*av) += val;
-    if (*mn > val) *mn = val;
-    if (*mx < val) *mx = val;
+static void swap_ints(int* a, int i, int j) {
+    int tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
 }
 
-void compute_stats(int t, int show_what) {
-    double av_money = 0;
-    double min_money = 1e9;
-    double max_money = 0;
-    double av_csmp = 0;
-    double min_csmp = 1e9;
-    double max_csmp = 0;
-    double av_prod = 0;
-    double min_prod = 1e9;
-    double max_prod = 0;
-    double av_price = 0;
-    double min_price = 1e9;
-    double max_price = 0;
-    double av_tot_prod = 0;
-    double av_min_prod = 1e9;
-    double av_max_prod = 0;
-    double av_tot_csmp = 0;
-    double av_min_csmp = 1e9;
-    double av_max_csmp = 0;
-    int num_in_poverty = 0;
-    
-    for (int i = 0; i < _ags.num; i++) {
-        ag_t* ag = AG_PTR(i);
-        set_av_max_min(ag->money + ag->money_gained, &av_money, &max_money, 
-					   &min_money);
-        set_av_max_min(ag->csmp, &av_csmp, &max_csmp, &min_csmp);
-        set_av_max_min(ag->max_prod - ag->unsold_prod, 
-					   &av_prod, &max_prod, &min_prod);
-        set_av_max_min(ag->prod_price, &av_price, &max_price, &min_price);
-        set_av_max_min(ag->tot_csmp / t, &av_tot_csmp, 
-                       &av_max_csmp, &av_min_csmp);
-        set_av_max_min(ag->tot_prod / t, &av_tot_prod, 
-                       &av_max_prod, &av_min_prod);
-		if (show_what == SHOW_LIFETIME) {
-			if (ag->tot_csmp / t < 1.0) num_in_poverty++;
-		} else {
-			if (ag->csmp < 1.0) num_in_poverty++;
-		}
+// Merges two adjacent shuffled runs, [lo, mid) and [mid, hi), into a single
+// shuffled run in place: a coin flip picks which run the next element comes
+// from, and whatever is left once one run is used up is inserted at random
+// positions, as in Fisher-Yates. This gives a uniform permutation (see
+// Bacher et al., "MergeShuffle").
+static void merge_shuffled(int* a, int lo, int mid, int hi, unsigned int seed) {
+    rnd_bits_t rb = {.seed = seed, .num_bits = 0};
+    int i = lo, j = mid;
+    while (1) {
+        if (get_rnd_bit(&rb)) {
+            if (j == hi) break;
+            swap_ints(a, i, j++);
+        } else if (i == j) {
+            break;
+        }
+        i++;
     }
+    for (; i < hi; i++) swap_ints(a, i, lo + get_int_rnd_r(i - lo + 1, &rb.seed));
+}
 
-    av_money /= (double)_ags.num;
-    av_csmp /= (double)_ags.num;
-    av_prod /= (double)_ags.num;
-    av_price /= (double)_ags.num;
-    av_tot_csmp /= (double)_ags.num;
-    av_tot_prod /= (double)_ags.num;
+// Shuffles the consumers in parallel: each block is shuffled with its own
+// random stream, and then pairs of runs are merged, doubling the run length
+// each time, again with a stream per merge. The streams are seeded from a
+// single draw on the main stream, and the blocks don't depend on the number
+// of threads, so neither does the result.
+static void shuffle_csmrs(void) {
+    int n = _csmrs.num;
+    int num_blocks = (n + SHUFFLE_BLOCK_SIZE - 1) / SHUFFLE_BLOCK_SIZE;
+    unsigned int base_seed = get_int_rnd(1 << 30);
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < num_blocks; b++) {
+        unsigned int seed = get_stream_seed(base_seed, b);
+        int lo = b * SHUFFLE_BLOCK_SIZE;
+        for (int i = (b + 1) * SHUFFLE_BLOCK_SIZE < n ? (b + 1) * SHUFFLE_BLOCK_SIZE - 1 : n - 1;
+             i > lo; i--) {
+            swap_ints(_csmrs._, i, lo + get_int_rnd_r(i - lo + 1, &seed));
+        }
+    }
+    int level = 1;
+    for (int width = SHUFFLE_BLOCK_SIZE; width < n; width *= 2, level++) {
+        int num_pairs = (n + 2 * width - 1) / (2 * width);
+#pragma omp parallel for schedule(static)
+        for (int p = 0; p < num_pairs; p++) {
+            int lo = p * 2 * width;
+            int mid = lo + width;
+            int hi = mid + width < n ? mid + width : n;
+            if (mid >= n) continue;
+            merge_shuffled(_csmrs._, lo, mid, hi,
+                           get_stream_seed(base_seed, level * num_blocks + p));
+        }
+    }
+}
+
+// An alternative to picking a random consumer for every trade: the consumers
+// are shuffled once, and then each makes one purchase per pass, in shuffled
+// order, until the market clears. Consumers and producers that are done are
+// only removed between passes, so each pass streams through the list in
+// order; producers are only compacted once enough of them have sold out,
+// since a pass may be short once only a few consumers are left. Anything left
+// over (the degenerate case of a lone agent trying to buy from itself) is
+// handled by the random clearing.
+void clear_shuffled(void) {
+    shuffle_csmrs();
+    int num_sold_out = 0;
+    while (_csmrs.num && _prdrs.num) {
+        long num_trades = _num_trades;
+        for (int i = 0; i < _csmrs.num; i++) {
+            if (i + CSMR_PREFETCH_DIST < _csmrs.num) {
+                __builtin_prefetch(&_ags._[_csmrs._[i + CSMR_PREFETCH_DIST]]);
+            }
+            int prdr_i = find_cheapest_prdr(i);
+            if (prdr_i == -1) continue;
+            ag_t* prdr = &_ags._[_prdrs._[prdr_i]];
+            // a consumer that can't afford even the smallest amount is done
+            if (trade(&_ags._[_csmrs._[i]], prdr) == 0) _csmrs._[i] = -1;
+            if (prdr->unsold_prod == 0) num_sold_out++;
+        }
+        // now compact the lists, keeping the consumers in shuffled order
+        int num = 0;
+        for (int i = 0; i < _csmrs.num; i++) {
+            if (_csmrs._[i] == -1) continue;
+            ag_t* csmr = &_ags._[_csmrs._[i]];
+            if (csmr->money == 0 || csmr->csmp >= csmr->max_csmp) continue;
+            _csmrs._[num++] = _csmrs._[i];
+        }
+        _csmrs.num = num;
+        if (num_sold_out > _prdrs.num / 8 || _num_trades == num_trades) {
+            num = 0;
+            for (int i = 0; i < _prdrs.num; i++) {
+                if (_ags._[_prdrs._[i]].unsold_prod > 0) _prdrs._[num++] = _prdrs._[i];
+            }
+            _prdrs.num = num;
+            num_sold_out = 0;
+        }
+        DBG_START(VFLAG_PC_LISTS) {
+            print_array("csmrs: ", _csmrs._, _csmrs.num);
+            print_array("prdrs: ", _prdrs._, _prdrs.num);
+        }
+        if (_num_trades == num_trades && _csmrs.num == 1 && _prdrs.num == 1) break;
+    }
+}
+
+// agents are summed in blocks of this size before the blocks are combined
+#define STATS_BLOCK_SIZE 4096
+
+#define SET_AV_MAX_MIN(val, av, mx, mn)         \
+    do {                                        \
+        (av) += (val);                          \
+        if ((mn) > (val)) (mn) = (val);         \
+        if ((mx) < (val)) (mx) = (val);         \
+    } while (0)
+
+#define MERGE_AV_MAX_MIN(st, other, av, mx, mn)     \
+    do {                                            \
+        (st)->av += (other)->av;                    \
+        if ((st)->mn > (other)->mn) (st)->mn = (other)->mn; \
+        if ((st)->mx < (other)->mx) (st)->mx = (other)->mx; \
+    } while (0)
+
+void clear_stats(stats_t* st) {
+    st->money = st->csmp = st->prod = st->tot_csmp = st->tot_prod = 0;
+    st->max_money = st->max_csmp = st->max_prod = st->max_tot_csmp = st->max_tot_prod = 0;
+    st->min_money = st->min_csmp = st->min_prod = st->min_tot_csmp = st->min_tot_prod = AMT_MAX;
+    st->price = st->max_price = 0;
+    st->min_price = 1e9;
+    st->num_in_poverty = 0;
+}
+
+void add_ag_stats(stats_t* st, ag_t* ag, int t, int show_what) {
+    SET_AV_MAX_MIN(ag->money + ag->money_gained, st->money, st->max_money,
+                   st->min_money);
+    SET_AV_MAX_MIN(ag->csmp, st->csmp, st->max_csmp, st->min_csmp);
+    SET_AV_MAX_MIN(ag->max_prod - ag->unsold_prod, st->prod, st->max_prod,
+                   st->min_prod);
+    SET_AV_MAX_MIN(ag->prod_price, st->price, st->max_price, st->min_price);
+    SET_AV_MAX_MIN(ag->tot_csmp, st->tot_csmp, st->max_tot_csmp, st->min_tot_csmp);
+    SET_AV_MAX_MIN(ag->tot_prod, st->tot_prod, st->max_tot_prod, st->min_tot_prod);
+    if (show_what == SHOW_LIFETIME) {
+        if (FROM_AMT(ag->tot_csmp) / t < 1.0) st->num_in_poverty++;
+    } else {
+        if (FROM_AMT(ag->csmp) < 1.0) st->num_in_poverty++;
+    }
+}
+
+void merge_stats(stats_t* st, stats_t* other) {
+    MERGE_AV_MAX_MIN(st, other, money, max_money, min_money);
+    MERGE_AV_MAX_MIN(st, other, csmp, max_csmp, min_csmp);
+    MERGE_AV_MAX_MIN(st, other, prod, max_prod, min_prod);
+    MERGE_AV_MAX_MIN(st, other, price, max_price, min_price);
+    MERGE_AV_MAX_MIN(st, other, tot_csmp, max_tot_csmp, min_tot_csmp);
+    MERGE_AV_MAX_MIN(st, other, tot_prod, max_tot_prod, min_tot_prod);
+    st->num_in_poverty += other->num_in_poverty;
+}
+
+void get_stats(int t, int show_what, stats_t* st) {
+    // each block of agents is summed in agent order, and the blocks are then
+    // combined pairwise in a fixed tree, so the result is the same however
+    // many threads are used
+    int num_blocks = (_ags.num + STATS_BLOCK_SIZE - 1) / STATS_BLOCK_SIZE;
+    if (!num_blocks) {
+        // with no agents there is nothing to take the max or min of either
+        memset(st, 0, sizeof(stats_t));
+        return;
+    }
+    stats_t* block_stats = malloc(num_blocks * sizeof(stats_t));
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < num_blocks; b++) {
+        clear_stats(&block_stats[b]);
+        int end = (b + 1) * STATS_BLOCK_SIZE;
+        if (end > _ags.num) end = _ags.num;
+        for (int i = b * STATS_BLOCK_SIZE; i < end; i++) {
+            add_ag_stats(&block_stats[b], &_ags._[i], t, show_what);
+        }
+    }
+    for (int stride = 1; stride < num_blocks; stride *= 2) {
+        for (int b = 0; b + stride < num_blocks; b += 2 * stride) {
+            merge_stats(&block_stats[b], &block_stats[b + stride]);
+        }
+    }
+    *st = block_stats[0];
+    free(block_stats);
+}
+
+void compute_stats(int t, int show_what) {
+    stats_t st;
+    get_stats(t, show_what, &st);
+
+    double av_money = FROM_AMT(st.money) / (double)_ags.num;
+    double max_money = FROM_AMT(st.max_money);
+    double min_money = FROM_AMT(st.min_money);
+    double av_csmp = FROM_AMT(st.csmp) / (double)_ags.num;
+    double max_csmp = FROM_AMT(st.max_csmp);
+    double min_csmp = FROM_AMT(st.min_csmp);
+    double av_prod = FROM_AMT(st.prod) / (double)_ags.num;
+    double max_prod = FROM_AMT(st.max_prod);
+    double min_prod = FROM_AMT(st.min_prod);
+    double av_price = st.price / (double)_ags.num;
+    double max_price = st.max_price;
+    double min_price = st.min_price;
+    double av_tot_csmp = FROM_AMT(st.tot_csmp) / t / (double)_ags.num;
+    double av_max_csmp = FROM_AMT(st.max_tot_csmp) / t;
+    double av_min_csmp = FROM_AMT(st.min_tot_csmp) / t;
+    double av_tot_prod = FROM_AMT(st.tot_prod) / t / (double)_ags.num;
+    double av_max_prod = FROM_AMT(st.max_tot_prod) / t;
+    double av_min_prod = FROM_AMT(st.min_tot_prod) / t;
+    int num_in_poverty = st.num_in_poverty;
 
 	if (show_what == SHOW_LIFETIME) {
 		printf(" LIFETIME\n");
+		// in fixed point, this should be exactly zero
+		printf(" money drift %.3e\n",
+			   FROM_AMT(st.money - _money_initial - _money_injected));
 		mprintf(14, "%8d", t, 
 				"%7.2f", av_money, "%7.2f", max_money, "%7.2f", min_money,
 				"%7.3f", av_price, "%7.2f", max_price, "%7.2f", min_price,
 				"%7.2f", av_tot_csmp, "%7.2f", av_max_csmp, "%7.2f", av_min_csmp, 
 				"%7.2f", av_tot_prod, "%7.2f", av_max_prod, "%7.2f", av_min_prod, 
 				"%7.1f\n", (double)num_in_poverty * 100.0 / (double)_ags.num);
+		// the averages at full precision, for comparing runs statistically
+		DBG_START(VFLAG_PRECISE) {
+			printf(" PRECISE av PP %.9f av C %.9f pvt %.9f\n", av_price, av_tot_csmp,
+				   (double)num_in_poverty * 100.0 / (double)_ags.num);
+		}
 	} else {
 		mprintf(14, "%8d", t, 
 				"%7.2f", av_money, "%7.2f", max_money, "%7.3f", min_money,
@@ -430,8 +800,9 @@ void print_ags(void) {
 }
 
 void print_ag(ag_t* ag) {
-    mprintf(8, "%4d", ag->id, "%8.2f", ag->money, "%8.2f", ag->unsold_prod, "%8.2f", 
-            ag->csmp, "%8.2f", ag->prod_price, "%8.2f", ag->tot_csmp / (_iters + 1), 
-            "%8.2f\n", ag->tot_prod / (_iters + 1));
+    mprintf(8, "%4d", ag->id, "%8.2f", FROM_AMT(ag->money), "%8.2f",
+            FROM_AMT(ag->unsold_prod), "%8.2f", FROM_AMT(ag->csmp), "%8.2f",
+            ag->prod_price, "%8.2f", FROM_AMT(ag->tot_csmp) / (_iters + 1),
+            "%8.2f\n", FROM_AMT(ag->tot_prod) / (_iters + 1));
 }
         
@@ -0,0 +1,76 @@
+#ifndef _DISMAL_H
+#define _DISMAL_H
+
+#include "cfg.h"
+#include "amt.h"
+
+// units of production and consumption are integers because they cannot be
+// divided too finely 
+typedef struct {
+    int id;
+    // these are all fixed for the life of the agent 
+    amt_t max_csmp;
+    amt_t max_prod;
+
+    // these fluctuate from one round to the next
+    amt_t money;
+	// how much money has been gained in this round
+	amt_t money_gained;
+	// how much production is still unsold
+    amt_t unsold_prod;
+    amt_t csmp;
+    // total consumption over this agent's lifetime
+    amt_t tot_csmp;
+    // total production over the lifetime of this agent
+    amt_t tot_prod;
+    double prod_price;
+	// how much adjustment will this agent do to correct price issues?
+	double price_adjust;
+    // iterations in the current poverty spell, and in the longest one
+    int pvt_spell;
+    int max_pvt_spell;
+} ag_t;
+
+typedef struct {
+    ag_t* _;
+    int num;
+} ags_t;
+
+// statistics over a set of agents. Amounts are summed as amounts, so in fixed
+// point the sums are exact
+typedef struct {
+    amt_sum_t money;
+    amt_t max_money, min_money;
+    amt_sum_t csmp;
+    amt_t max_csmp, min_csmp;
+    amt_sum_t prod;
+    amt_t max_prod, min_prod;
+    double price, max_price, min_price;
+    amt_sum_t tot_csmp;
+    amt_t max_tot_csmp, min_tot_csmp;
+    amt_sum_t tot_prod;
+    amt_t max_tot_prod, min_tot_prod;
+    int num_in_poverty;
+} stats_t;
+
+#define SHOW_ROUND 0
+#define SHOW_LIFETIME 1
+
+// this is called in the sweeps that already go over every agent after the
+// trading, so it adds no pass of its own, and it has no branches to speak of
+static inline void update_pvt_spell(ag_t* ag) {
+    int in_poverty = FROM_AMT(ag->csmp) < 1.0;
+    ag->pvt_spell = in_poverty * (ag->pvt_spell + 1);
+    if (ag->max_pvt_spell < ag->pvt_spell) ag->max_pvt_spell = ag->pvt_spell;
+}
+
+extern ags_t _ags;
+extern cfg_t _cfg;
+extern int _iters;
+
+void init();
+void run_sim(void);
+void compute_price(ag_t* ag);
+void get_stats(int t, int show_what, stats_t* st);
+
+#endif
@@ -0,0 +1,37 @@
+/**
+   dismal-hist: prints the history of a single agent from a file written by a
+   dismal simulation (run with --history_file).
+
+   Usage: dismal-hist <history file> <agent id> [print every n iterations]
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "utils.h"
+#include "history.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s <history file> <agent id> [print every n iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int ag_id = atoi(argv[2]);
+    int print_every = argc > 3 ? atoi(argv[3]) : 1;
+    if (print_every < 1) print_every = 1;
+
+    double* vals;
+    int mantissa_bits;
+    int num_iters = hist_read_ag(argv[1], ag_id, &vals, &mantissa_bits);
+    printf("Agent %d, %d iterations\n", ag_id, num_iters);
+    if (mantissa_bits < 52) {
+        printf("Lossy: only %d of 52 mantissa bits were kept\n", mantissa_bits);
+    }
+    mprintf(5, "%8s", "t", "%10s", "$", "%10s", "PP", "%10s", "C", "%10s", "unsold\n");
+    for (int t = 0; t < num_iters; t += print_every) {
+        double* v = &vals[t * HIST_NUM_FIELDS];
+        mprintf(5, "%8d", t + 1, "%10.3f", v[HIST_MONEY], "%10.3f", v[HIST_PRICE],
+                "%10.3f", v[HIST_CSMP], "%10.3f\n", v[HIST_UNSOLD_PROD]);
+    }
+    free(vals);
+    return 0;
+}
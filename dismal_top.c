@@ -0,0 +1,98 @@
+/**
+   dismal-top: attaches to the live telemetry of a running dismal simulation
+   (started with --telemetry) and tails the per-iteration aggregates.
+
+   Usage: dismal-top [shm name] [print every n records]
+**/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "utils.h"
+#include "telemetry.h"
+
+static void print_header(void) {
+    mprintf(16, "%8s", "t",
+            "%7s", "av $", "%7s", "mx $", "%7s", "mn $",
+            "%7s", "av PP", "%7s", "mx PP", "%7s", "mn PP",
+            "%7s", "av C", "%7s", "mx C", "%7s", "mn C",
+            "%7s", "av P", "%7s", "mx P", "%7s", "mn P",
+            "%7s", "pvt", "%10s", "trades", "%9s", "ms/iter\n");
+}
+
+static void print_rec(tl_rec_t* rec, int num_ags) {
+    mprintf(16, "%8d", rec->iter + 1,
+            "%7.2f", rec->av_money, "%7.2f", rec->max_money, "%7.3f", rec->min_money,
+            "%7.3f", rec->av_price, "%7.3f", rec->max_price, "%7.3f", rec->min_price,
+            "%7.3f", rec->av_csmp, "%7.3f", rec->max_csmp, "%7.3f", rec->min_csmp,
+            "%7.3f", rec->av_prod, "%7.3f", rec->max_prod, "%7.3f", rec->min_prod,
+            "%7.1f", (double)rec->num_in_poverty * 100.0 / (double)num_ags,
+            "%10d", (int)rec->num_trades, "%9.3f\n", rec->iter_time * 1000.0);
+}
+
+// the writer normally marks the ring as done before it goes, but if it was
+// killed, or the ring has been unlinked, nothing more will be written
+static int is_writer_gone(tl_ring_t* ring, const char* name) {
+    if (kill(ring->pid, 0) == -1 && errno == ESRCH) return 1;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) return errno == ENOENT;
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* name = argc > 1 ? argv[1] : "/dismal";
+    int print_every = argc > 2 ? atoi(argv[2]) : 1;
+    if (print_every < 1) print_every = 1;
+
+    tl_ring_t* ring;
+    while (!(ring = tl_attach(name))) {
+        fprintf(stderr, "Waiting for telemetry %s...\n", name);
+        sleep(1);
+    }
+    printf("Attached to %s: %d agents, %d iterations\n", name, ring->num_ags,
+           ring->num_iters);
+    print_header();
+
+    uint64_t rec_i = 0;
+    uint64_t num_lost = 0;
+    uint64_t num_recs = 0;
+    int lines = 0;
+    while (1) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        // if we fell too far behind, skip what has already been overwritten
+        if (head - rec_i > ring->num_slots) {
+            num_lost += head - ring->num_slots - rec_i;
+            rec_i = head - ring->num_slots;
+        }
+        for (; rec_i < head; rec_i++) {
+            tl_rec_t rec;
+            if (!tl_read(ring, rec_i, &rec)) {
+                num_lost++;
+                continue;
+            }
+            if (num_recs++ % print_every) continue;
+            print_rec(&rec, ring->num_ags);
+            if (++lines % 40 == 0) print_header();
+        }
+        if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE) &&
+            rec_i == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        // the head is checked after the writer, so nothing it wrote is missed
+        if (!__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE) && is_writer_gone(ring, name) &&
+            rec_i == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+            printf("Simulation stopped without finishing, %lu records lost\n",
+                   (unsigned long)num_lost);
+            return EXIT_FAILURE;
+        }
+        fflush(stdout);
+        usleep(100000);
+    }
+    printf("Simulation finished, %lu records lost\n", (unsigned long)num_lost);
+    return 0;
+}
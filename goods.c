@@ -0,0 +1,250 @@
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "utils.h"
+#include "dismal.h"
+#include "goods.h"
+
+static struct {
+    good_t* _;
+    int num;
+    // all the (agent, good) entries, stored contiguously by good
+    gd_prdr_t* prdrs;
+    gd_csmr_t* csmrs;
+    int* prdr_lists;
+    int* csmr_lists;
+    // where each agent's entries are, by agent, so the results can be folded
+    // back into the agents in a single sweep over them
+    int num_per_ag;
+    size_t* ag_prdrs;
+    size_t* ag_csmrs;
+} _goods;
+
+// picks num_sel distinct goods at random for an agent
+static void select_goods(int* sel, int num_sel) {
+    for (int i = 0; i < num_sel; i++) {
+        int dup;
+        do {
+            sel[i] = get_int_rnd(_goods.num);
+            dup = 0;
+            for (int j = 0; j < i; j++) {
+                if (sel[j] == sel[i]) dup = 1;
+            }
+        } while (dup);
+    }
+}
+
+// splits an agent's capacity or demand over its goods in random proportions,
+// which add up to 1
+static void select_shares(double* shares, int num_sel) {
+    double tot = 0;
+    for (int i = 0; i < num_sel; i++) {
+        shares[i] = get_double_rnd(0.5, 1.5);
+        tot += shares[i];
+    }
+    for (int i = 0; i < num_sel; i++) shares[i] /= tot;
+}
+
+void init_goods(void) {
+    _goods.num = _cfg.num_goods;
+    int num_per_ag = _cfg.goods_per_ag;
+    if (num_per_ag > _goods.num) num_per_ag = _goods.num;
+    if (num_per_ag < 1) {
+        FAIL("Agents must produce and consume at least one good, not %d\n",
+             num_per_ag);
+    }
+    size_t num_entries = (size_t)_ags.num * num_per_ag;
+    _goods._ = calloc(_goods.num, sizeof(good_t));
+    _goods.prdrs = calloc(num_entries, sizeof(gd_prdr_t));
+    _goods.csmrs = calloc(num_entries, sizeof(gd_csmr_t));
+    _goods.prdr_lists = calloc(num_entries, sizeof(int));
+    _goods.csmr_lists = calloc(num_entries, sizeof(int));
+    _goods.num_per_ag = num_per_ag;
+    _goods.ag_prdrs = malloc(num_entries * sizeof(size_t));
+    _goods.ag_csmrs = malloc(num_entries * sizeof(size_t));
+
+    // first choose the goods and their shares for every agent, then lay the
+    // entries out by good
+    int* prdr_sel = malloc(num_entries * sizeof(int));
+    int* csmr_sel = malloc(num_entries * sizeof(int));
+    double* prdr_shares = malloc(num_entries * sizeof(double));
+    double* csmr_shares = malloc(num_entries * sizeof(double));
+    for (int i = 0; i < _ags.num; i++) {
+        size_t first = (size_t)i * num_per_ag;
+        select_goods(&prdr_sel[first], num_per_ag);
+        select_goods(&csmr_sel[first], num_per_ag);
+        select_shares(&prdr_shares[first], num_per_ag);
+        select_shares(&csmr_shares[first], num_per_ag);
+    }
+    for (size_t i = 0; i < num_entries; i++) {
+        _goods._[prdr_sel[i]].num_prdrs++;
+        _goods._[csmr_sel[i]].num_csmrs++;
+    }
+    size_t prdrs_offset = 0;
+    size_t csmrs_offset = 0;
+    for (int g = 0; g < _goods.num; g++) {
+        good_t* gd = &_goods._[g];
+        gd->prdrs = &_goods.prdrs[prdrs_offset];
+        gd->prdr_list = &_goods.prdr_lists[prdrs_offset];
+        gd->csmrs = &_goods.csmrs[csmrs_offset];
+        gd->csmr_list = &_goods.csmr_lists[csmrs_offset];
+        prdrs_offset += gd->num_prdrs;
+        csmrs_offset += gd->num_csmrs;
+        // these are used as fill counters below
+        gd->num_prdrs = 0;
+        gd->num_csmrs = 0;
+        gd->rnd_seed = get_stream_seed(_cfg.rseed, g);
+    }
+    for (size_t i = 0; i < num_entries; i++) {
+        int ag_id = i / num_per_ag;
+        good_t* gd = &_goods._[prdr_sel[i]];
+        _goods.ag_prdrs[i] = gd->prdrs - _goods.prdrs + gd->num_prdrs;
+        gd_prdr_t* prdr = &gd->prdrs[gd->num_prdrs++];
+        prdr->ag_id = ag_id;
+        prdr->share = prdr_shares[i];
+        prdr->prod_price = _ags._[ag_id].prod_price;
+        gd = &_goods._[csmr_sel[i]];
+        _goods.ag_csmrs[i] = gd->csmrs - _goods.csmrs + gd->num_csmrs;
+        gd_csmr_t* csmr = &gd->csmrs[gd->num_csmrs++];
+        csmr->ag_id = ag_id;
+        csmr->share = csmr_shares[i];
+    }
+    free(prdr_sel);
+    free(csmr_sel);
+    free(prdr_shares);
+    free(csmr_shares);
+}
+
+static int find_cheapest_gd_prdr(good_t* gd, int num_prdrs, int csmr_ag_id) {
+    double min_price = 1e9;
+    int prdr_i_sel = -1;
+    for (int i = 0; i < _cfg.prdr_sample_size; i++) {
+        int prdr_i = get_int_rnd_r(num_prdrs, &gd->rnd_seed);
+        gd_prdr_t* prdr = &gd->prdrs[gd->prdr_list[prdr_i]];
+        if (prdr->ag_id == csmr_ag_id) continue;
+        if (prdr->prod_price < min_price) {
+            min_price = prdr->prod_price;
+            prdr_i_sel = prdr_i;
+        }
+    }
+    return prdr_i_sel;
+}
+
+// clears the market for a single good and returns the number of trades. This
+// only writes to the good's own entries, and only reads the agents, so goods
+// can be cleared in parallel
+static long clear_good(good_t* gd) {
+    long num_trades = 0;
+    int num_prdrs = 0;
+    int num_csmrs = 0;
+    for (int i = 0; i < gd->num_prdrs; i++) {
+        gd_prdr_t* prdr = &gd->prdrs[i];
+        prdr->max_prod = TO_AMT(FROM_AMT(_ags._[prdr->ag_id].max_prod) * prdr->share);
+        prdr->unsold_prod = prdr->max_prod;
+        if (prdr->unsold_prod > 0) gd->prdr_list[num_prdrs++] = i;
+    }
+    for (int i = 0; i < gd->num_csmrs; i++) {
+        gd_csmr_t* csmr = &gd->csmrs[i];
+        ag_t* ag = &_ags._[csmr->ag_id];
+        csmr->max_csmp = TO_AMT(FROM_AMT(ag->max_csmp) * csmr->share);
+        // in fixed point this rounds down, so the budgets never add up to
+        // more than the agent has
+        csmr->budget = TO_AMT(FROM_AMT(ag->money) * csmr->share);
+        csmr->csmp = 0;
+        csmr->spent = 0;
+        if (csmr->budget > 0) gd->csmr_list[num_csmrs++] = i;
+    }
+
+    while (num_csmrs && num_prdrs) {
+        int csmr_i = get_int_rnd_r(num_csmrs, &gd->rnd_seed);
+        gd_csmr_t* csmr = &gd->csmrs[gd->csmr_list[csmr_i]];
+        int prdr_i = find_cheapest_gd_prdr(gd, num_prdrs, csmr->ag_id);
+        if (prdr_i == -1) {
+            // the only producer left could be this consumer
+            if (num_prdrs == 1 && num_csmrs == 1) break;
+            continue;
+        }
+        gd_prdr_t* prdr = &gd->prdrs[gd->prdr_list[prdr_i]];
+
+        // this follows consume() in the single-good model
+        amt_t csmp, csmp_cost;
+        get_trade(csmr->max_csmp - csmr->csmp, csmr->budget, prdr->unsold_prod,
+                  prdr->prod_price, &csmp, &csmp_cost);
+        prdr->unsold_prod -= csmp;
+        CLAMP_ROUND_OFF(prdr->unsold_prod);
+        prdr->tot_prod += csmp;
+        if (FROM_AMT(csmr->budget - csmp_cost) < -0.00001) {
+            FAIL("csmr %d has less budget %.2f than what is needed for consumption %.2f\n",
+                 csmr->ag_id, FROM_AMT(csmr->budget), FROM_AMT(csmp_cost));
+        }
+        prdr->money_gained += csmp_cost;
+        csmr->budget -= csmp_cost;
+        csmr->spent += csmp_cost;
+        CLAMP_ROUND_OFF(csmr->budget);
+        csmr->csmp += csmp;
+        csmr->tot_csmp += csmp;
+        num_trades++;
+
+        if (prdr->unsold_prod == 0) gd->prdr_list[prdr_i] = gd->prdr_list[--num_prdrs];
+        if (csmr->budget == 0 || csmr->csmp >= csmr->max_csmp || csmp == 0) {
+            gd->csmr_list[csmr_i] = gd->csmr_list[--num_csmrs];
+        }
+    }
+
+    // compute new prices, as compute_price() does for the single-good model
+    for (int i = 0; i < gd->num_prdrs; i++) {
+        gd_prdr_t* prdr = &gd->prdrs[i];
+        if (prdr->max_prod <= 0) continue;
+        double exptd_prod = FROM_AMT(prdr->tot_prod) / (_iters + 1);
+        double unsold_prod = FROM_AMT(prdr->unsold_prod);
+        double price_change =
+            get_double_rnd_r(0, fabs(exptd_prod - unsold_prod) / FROM_AMT(prdr->max_prod),
+                             &gd->rnd_seed) * _ags._[prdr->ag_id].price_adjust;
+        if (exptd_prod < unsold_prod) price_change *= -1.0;
+        prdr->prod_price += price_change;
+        double min_price = 0.00001;
+        if (prdr->prod_price < min_price) prdr->prod_price = min_price;
+    }
+    return num_trades;
+}
+
+long clear_goods(void) {
+    // realize the gains from the previous round, as update_ag() does
+    for (int i = 0; i < _ags.num; i++) {
+        ag_t* ag = &_ags._[i];
+        ag->money += ag->money_gained;
+        ag->money_gained = 0;
+    }
+
+    long num_trades = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:num_trades)
+    for (int g = 0; g < _goods.num; g++) num_trades += clear_good(&_goods._[g]);
+
+    // now fold the results for each good back into the agents. This is done
+    // serially, in a fixed order, so the result doesn't depend on the threads,
+    // and the poverty spells are updated in the same sweep, once each agent's
+    // consumption is complete
+    for (int i = 0; i < _ags.num; i++) {
+        ag_t* ag = &_ags._[i];
+        ag->csmp = 0;
+        ag->unsold_prod = 0;
+        ag->prod_price = 0;
+        size_t first = (size_t)i * _goods.num_per_ag;
+        for (size_t k = first; k < first + _goods.num_per_ag; k++) {
+            gd_csmr_t* csmr = &_goods.csmrs[_goods.ag_csmrs[k]];
+            ag->money -= csmr->spent;
+            CLAMP_ROUND_OFF(ag->money);
+            ag->csmp += csmr->csmp;
+            ag->tot_csmp += csmr->csmp;
+            gd_prdr_t* prdr = &_goods.prdrs[_goods.ag_prdrs[k]];
+            ag->money_gained += prdr->money_gained;
+            prdr->money_gained = 0;
+            ag->unsold_prod += prdr->unsold_prod;
+            ag->tot_prod += prdr->max_prod - prdr->unsold_prod;
+            // the agent's price is the average over its goods
+            ag->prod_price += prdr->share * prdr->prod_price;
+        }
+        update_pvt_spell(ag);
+    }
+    return num_trades;
+}
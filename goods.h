@@ -0,0 +1,63 @@
+#ifndef _GOODS_H
+#define _GOODS_H
+
+#include "amt.h"
+
+// Multi-good mode: instead of a single undifferentiated good, there are
+// num_goods goods, and each agent produces and consumes goods_per_ag of them,
+// selected at random. Only the (agent, good) pairs that exist are stored, so
+// memory scales with num_ags * goods_per_ag rather than num_ags * num_goods.
+//
+// Each round, an agent's money is split into a budget per good it consumes,
+// in proportion to its demand for that good, and its production capacity is
+// split the same way across the goods it produces, with shares drawn at
+// random for each agent when the goods are set up. That makes the markets for
+// different goods independent within a round, so each can be cleared on its
+// own, in parallel, with all of its data in one contiguous block. The per-good
+// results are then folded back into the agents, so that the ag_t fields hold
+// the totals over all goods and the stats work as in the single-good model.
+
+// an agent's production of one good
+typedef struct {
+    int ag_id;
+    // fraction of the agent's production capacity that goes to this good
+    double share;
+    // production capacity for this good in the current round
+    amt_t max_prod;
+    amt_t unsold_prod;
+    amt_t tot_prod;
+    double prod_price;
+    amt_t money_gained;
+} gd_prdr_t;
+
+// an agent's consumption of one good
+typedef struct {
+    int ag_id;
+    // fraction of the agent's consumption (and money) that goes to this good
+    double share;
+    // consumption wanted for this good in the current round
+    amt_t max_csmp;
+    amt_t csmp;
+    amt_t tot_csmp;
+    // money available for this good in the current round
+    amt_t budget;
+    amt_t spent;
+} gd_csmr_t;
+
+typedef struct {
+    gd_prdr_t* prdrs;
+    int num_prdrs;
+    gd_csmr_t* csmrs;
+    int num_csmrs;
+    // the producers and consumers still active in the current round
+    int* prdr_list;
+    int* csmr_list;
+    // each good has its own random stream so goods can be cleared in parallel
+    unsigned int rnd_seed;
+} good_t;
+
+void init_goods(void);
+// clears the markets for all goods and returns the number of trades
+long clear_goods(void);
+
+#endif
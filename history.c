@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "utils.h"
+#include "history.h"
+
+// a single agent's compressed stream for the current chunk, along with the
+// compression state of each of its series
+typedef struct {
+    uint64_t prev[HIST_NUM_FIELDS];
+    // leading and trailing zeros of the last meaningful bits written, or
+    // HIST_NO_WINDOW at the start of a chunk
+    unsigned char lead[HIST_NUM_FIELDS];
+    unsigned char trail[HIST_NUM_FIELDS];
+    unsigned char* buf;
+    size_t len;
+    size_t cap;
+    // bits not yet written to buf, and, when reading, the bit position
+    uint64_t acc;
+    int acc_bits;
+    size_t pos;
+} hist_stream_t;
+
+#define HIST_NO_WINDOW 0xff
+
+static struct {
+    hist_stream_t* _;
+    int num;
+    FILE* f;
+    int window;
+    // low mantissa bits that are rounded off before compression
+    int drop_bits;
+    int first_iter;
+    int num_iters;
+    uint64_t* offsets;
+    // the snapshots of the agents' values are double buffered: one is filled
+    // by hist_record() while the writer thread compresses the other
+    double* snaps[2];
+    int fill;
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // the snapshot waiting for the writer, or -1, and its iteration
+    int pending;
+    int pending_iter;
+    int closing;
+} _hist;
+
+#define HIST_BLOCK_SIZE 64
+
+static void reset_stream(hist_stream_t* s) {
+    memset(s->prev, 0, sizeof(s->prev));
+    memset(s->lead, HIST_NO_WINDOW, sizeof(s->lead));
+    memset(s->trail, 0, sizeof(s->trail));
+    s->len = 0;
+    s->acc = 0;
+    s->acc_bits = 0;
+    s->pos = 0;
+}
+
+// stores the word big-endian, so the bits are in the order they were written,
+// but only advances by num_bytes
+static void put_word(hist_stream_t* s, uint64_t word, int num_bytes) {
+    if (s->len + 8 > s->cap) {
+        s->cap *= 2;
+        s->buf = realloc(s->buf, s->cap);
+    }
+    word = __builtin_bswap64(word);
+    memcpy(&s->buf[s->len], &word, 8);
+    s->len += num_bytes;
+}
+
+// writes the low num_bits of bits, which must have nothing set above them;
+// bits are gathered in a word, so there is only a store every 64 bits
+static void put_bits(hist_stream_t* s, uint64_t bits, int num_bits) {
+    int free_bits = 64 - s->acc_bits;
+    if (num_bits < free_bits) {
+        s->acc = (s->acc << num_bits) | bits;
+        s->acc_bits += num_bits;
+        return;
+    }
+    int rest = num_bits - free_bits;
+    if (free_bits == 64) put_word(s, bits, 8);
+    else put_word(s, (s->acc << free_bits) | (bits >> rest), 8);
+    s->acc = rest ? bits & ((1ULL << rest) - 1) : 0;
+    s->acc_bits = rest;
+}
+
+static void finish_stream(hist_stream_t* s) {
+    if (s->acc_bits) put_word(s, s->acc << (64 - s->acc_bits), (s->acc_bits + 7) / 8);
+    s->acc = 0;
+    s->acc_bits = 0;
+}
+
+static uint64_t get_bits(hist_stream_t* s, int num_bits) {
+    uint64_t bits = 0;
+    while (num_bits > 0) {
+        int avail_bits = 8 - s->pos % 8;
+        int n = num_bits < avail_bits ? num_bits : avail_bits;
+        unsigned char byte = s->buf[s->pos / 8];
+        bits = (bits << n) | ((byte >> (avail_bits - n)) & ((1 << n) - 1));
+        s->pos += n;
+        num_bits -= n;
+    }
+    return bits;
+}
+
+// A value that is the same as the previous one is a single 0 bit. Otherwise
+// the XOR with the previous value is written as a 1 bit, followed by either a
+// 0 bit and the meaningful bits, if they fit in the last window of leading
+// and trailing zeros, or a 1 bit, 5 bits of leading zeros, 6 bits of length
+// and the meaningful bits.
+static void encode_val(hist_stream_t* s, int field, double val) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    if (_hist.drop_bits) {
+        // round to nearest; a carry into the exponent is still the nearest
+        bits += 1ULL << (_hist.drop_bits - 1);
+        bits &= ~((1ULL << _hist.drop_bits) - 1);
+    }
+    uint64_t x = bits ^ s->prev[field];
+    s->prev[field] = bits;
+    if (!x) {
+        put_bits(s, 0, 1);
+        return;
+    }
+    int lead = __builtin_clzll(x);
+    int trail = __builtin_ctzll(x);
+    if (lead > 31) lead = 31;
+    if (s->lead[field] != HIST_NO_WINDOW && lead >= s->lead[field] &&
+        trail >= s->trail[field]) {
+        int len = 64 - s->lead[field] - s->trail[field];
+        if (len <= 62) {
+            put_bits(s, (2ULL << len) | (x >> s->trail[field]), len + 2);
+        } else {
+            put_bits(s, 2, 2);
+            put_bits(s, x >> s->trail[field], len);
+        }
+        return;
+    }
+    int len = 64 - lead - trail;
+    put_bits(s, (3 << 11) | (lead << 6) | (len - 1), 13);
+    put_bits(s, x >> trail, len);
+    s->lead[field] = lead;
+    s->trail[field] = trail;
+}
+
+static double decode_val(hist_stream_t* s, int field) {
+    if (get_bits(s, 1)) {
+        if (get_bits(s, 1)) {
+            s->lead[field] = get_bits(s, 5);
+            int len = get_bits(s, 6) + 1;
+            s->trail[field] = 64 - s->lead[field] - len;
+        }
+        int len = 64 - s->lead[field] - s->trail[field];
+        s->prev[field] ^= get_bits(s, len) << s->trail[field];
+    }
+    double val;
+    memcpy(&val, &s->prev[field], sizeof(val));
+    return val;
+}
+
+static void write_chunk(void) {
+    hist_chunk_hdr_t chdr = {.first_iter = _hist.first_iter, .num_iters = _hist.num_iters};
+    _hist.offsets[0] = 0;
+    for (int i = 0; i < _hist.num; i++) {
+        finish_stream(&_hist._[i]);
+        _hist.offsets[i + 1] = _hist.offsets[i] + _hist._[i].len;
+    }
+    chdr.data_size = _hist.offsets[_hist.num];
+    fwrite(&chdr, sizeof(chdr), 1, _hist.f);
+    fwrite(_hist.offsets, sizeof(uint64_t), _hist.num + 1, _hist.f);
+    for (int i = 0; i < _hist.num; i++) {
+        fwrite(_hist._[i].buf, 1, _hist._[i].len, _hist.f);
+        reset_stream(&_hist._[i]);
+    }
+    _hist.num_iters = 0;
+}
+
+// compresses a snapshot into the streams for the current chunk. Every agent
+// has its own stream, so blocks of agents are compressed in parallel
+static void compress_snap(double* snap) {
+#pragma omp parallel for schedule(static)
+    for (int first = 0; first < _hist.num; first += HIST_BLOCK_SIZE) {
+        int last = first + HIST_BLOCK_SIZE < _hist.num ? first + HIST_BLOCK_SIZE : _hist.num;
+        double* vals = &snap[(size_t)first * HIST_NUM_FIELDS];
+        for (int i = first; i < last; i++, vals += HIST_NUM_FIELDS) {
+            for (int j = 0; j < HIST_NUM_FIELDS; j++) encode_val(&_hist._[i], j, vals[j]);
+        }
+    }
+}
+
+// The writer thread takes each snapshot as it is recorded, compresses it,
+// and writes out the chunks, so none of that is on the simulation's path
+// unless the writer falls a whole snapshot behind.
+static void* write_hist(void* arg) {
+    while (1) {
+        pthread_mutex_lock(&_hist.lock);
+        while (_hist.pending == -1 && !_hist.closing) {
+            pthread_cond_wait(&_hist.cond, &_hist.lock);
+        }
+        int b = _hist.pending;
+        int iter = _hist.pending_iter;
+        _hist.pending = -1;
+        pthread_cond_broadcast(&_hist.cond);
+        pthread_mutex_unlock(&_hist.lock);
+        if (b == -1) break;
+        if (!_hist.num_iters) _hist.first_iter = iter;
+        compress_snap(_hist.snaps[b]);
+        if (++_hist.num_iters == _hist.window) write_chunk();
+    }
+    if (_hist.num_iters) write_chunk();
+    return NULL;
+}
+
+void hist_open(const char* fname, int num_ags, int window, int mantissa_bits) {
+    _hist.f = fopen(fname, "w");
+    if (!_hist.f) {
+        FAIL("Could not open history file %s\n", fname);
+    }
+    if (window < 1) window = 1;
+    if (mantissa_bits < 1 || mantissa_bits > 52) mantissa_bits = 52;
+    _hist.drop_bits = 52 - mantissa_bits;
+    _hist.num = num_ags;
+    _hist.window = window;
+    _hist.num_iters = 0;
+    _hist._ = calloc(num_ags, sizeof(hist_stream_t));
+    _hist.offsets = malloc((num_ags + 1) * sizeof(uint64_t));
+    for (int i = 0; i < num_ags; i++) {
+        // enough for a few bits per value; streams grow if they need more
+        _hist._[i].cap = window * HIST_NUM_FIELDS + 8;
+        _hist._[i].buf = malloc(_hist._[i].cap);
+        reset_stream(&_hist._[i]);
+    }
+    hist_hdr_t hdr = {.magic = HIST_MAGIC, .version = HIST_VERSION, .num_ags = num_ags,
+                      .window = window, .num_fields = HIST_NUM_FIELDS,
+                      .mantissa_bits = mantissa_bits};
+    fwrite(&hdr, sizeof(hdr), 1, _hist.f);
+    for (int b = 0; b < 2; b++) {
+        _hist.snaps[b] = malloc((size_t)num_ags * HIST_NUM_FIELDS * sizeof(double));
+    }
+    _hist.fill = 0;
+    _hist.pending = -1;
+    _hist.closing = 0;
+    pthread_mutex_init(&_hist.lock, NULL);
+    pthread_cond_init(&_hist.cond, NULL);
+    if (pthread_create(&_hist.writer, NULL, write_hist, NULL)) {
+        FAIL("Could not start the history writer for %s\n", fname);
+    }
+}
+
+void hist_record(int iter, ag_t* ags) {
+    // the buffer to fill was handed over two records ago, so once the writer
+    // has taken the last one, it is done with this one
+    pthread_mutex_lock(&_hist.lock);
+    while (_hist.pending != -1) pthread_cond_wait(&_hist.cond, &_hist.lock);
+    pthread_mutex_unlock(&_hist.lock);
+    double* snap = _hist.snaps[_hist.fill];
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < _hist.num; i++) {
+        ag_t* ag = &ags[i];
+        double* v = &snap[(size_t)i * HIST_NUM_FIELDS];
+        v[HIST_MONEY] = FROM_AMT(ag->money + ag->money_gained);
+        v[HIST_PRICE] = ag->prod_price;
+        v[HIST_CSMP] = FROM_AMT(ag->csmp);
+        v[HIST_UNSOLD_PROD] = FROM_AMT(ag->unsold_prod);
+    }
+    pthread_mutex_lock(&_hist.lock);
+    _hist.pending = _hist.fill;
+    _hist.pending_iter = iter;
+    pthread_cond_broadcast(&_hist.cond);
+    pthread_mutex_unlock(&_hist.lock);
+    _hist.fill ^= 1;
+}
+
+void hist_close(void) {
+    if (!_hist.f) return;
+    // the writer finishes the last snapshot and chunk before it goes
+    pthread_mutex_lock(&_hist.lock);
+    _hist.closing = 1;
+    pthread_cond_broadcast(&_hist.cond);
+    pthread_mutex_unlock(&_hist.lock);
+    pthread_join(_hist.writer, NULL);
+    fclose(_hist.f);
+    _hist.f = NULL;
+    for (int i = 0; i < _hist.num; i++) free(_hist._[i].buf);
+    free(_hist._);
+    free(_hist.offsets);
+    free(_hist.snaps[0]);
+    free(_hist.snaps[1]);
+}
+
+int hist_read_ag(const char* fname, int ag_id, double** vals, int* mantissa_bits) {
+    FILE* f = fopen(fname, "r");
+    if (!f) {
+        FAIL("Could not open history file %s\n", fname);
+    }
+    hist_hdr_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != HIST_MAGIC ||
+        hdr.version != HIST_VERSION || hdr.num_fields != HIST_NUM_FIELDS) {
+        FAIL("%s is not a history file\n", fname);
+    }
+    if (ag_id < 0 || ag_id >= hdr.num_ags) {
+        FAIL("Agent %d is not in %s, which has %d agents\n", ag_id, fname, hdr.num_ags);
+    }
+    *mantissa_bits = hdr.mantissa_bits;
+    int num_iters = 0;
+    int max_iters = hdr.window;
+    *vals = malloc(max_iters * HIST_NUM_FIELDS * sizeof(double));
+    hist_stream_t s = {.cap = 0, .buf = NULL};
+    long chunk_pos = sizeof(hdr);
+    hist_chunk_hdr_t chdr;
+    while (fseek(f, chunk_pos, SEEK_SET) == 0 && fread(&chdr, sizeof(chdr), 1, f) == 1) {
+        // only this agent's entries in the offsets table and its stream are read
+        long data_pos = chunk_pos + sizeof(chdr) + (hdr.num_ags + 1) * sizeof(uint64_t);
+        uint64_t offsets[2];
+        fseek(f, ag_id * sizeof(uint64_t), SEEK_CUR);
+        if (fread(offsets, sizeof(uint64_t), 2, f) != 2) {
+            FAIL("Truncated chunk at iteration %d in %s\n", chdr.first_iter, fname);
+        }
+        size_t size = offsets[1] - offsets[0];
+        if (size > s.cap) {
+            s.cap = size;
+            s.buf = realloc(s.buf, s.cap);
+        }
+        fseek(f, data_pos + offsets[0], SEEK_SET);
+        if (fread(s.buf, 1, size, f) != size) {
+            FAIL("Truncated chunk at iteration %d in %s\n", chdr.first_iter, fname);
+        }
+        if (num_iters + chdr.num_iters > max_iters) {
+            while (num_iters + chdr.num_iters > max_iters) max_iters *= 2;
+            *vals = realloc(*vals, max_iters * HIST_NUM_FIELDS * sizeof(double));
+        }
+        reset_stream(&s);
+        for (int t = 0; t < chdr.num_iters; t++, num_iters++) {
+            for (int j = 0; j < HIST_NUM_FIELDS; j++) {
+                (*vals)[num_iters * HIST_NUM_FIELDS + j] = decode_val(&s, j);
+            }
+        }
+        chunk_pos = data_pos + chdr.data_size;
+    }
+    free(s.buf);
+    fclose(f);
+    return num_iters;
+}
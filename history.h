@@ -0,0 +1,64 @@
+#ifndef _HISTORY_H
+#define _HISTORY_H
+
+#include <stdint.h>
+#include "dismal.h"
+
+// Per-agent trajectories: every iteration, the money, price, consumption and
+// unsold production of every agent are recorded, and compressed with XOR
+// (Gorilla-style) float compression, where each value is stored as the
+// meaningful bits of its XOR with the previous value of the same series.
+//
+// Each agent has its own compressed stream, and the streams are written out
+// every history_window iterations as a chunk. A chunk has a header, then a
+// table of where each agent's stream starts, then the streams, so a single
+// agent's history can be read by jumping from chunk to chunk, reading only
+// its own stream in each. The compression state is reset at the start of
+// every chunk, so each chunk can be decoded on its own.
+//
+// Recording an iteration only copies the agents' values into a snapshot. The
+// snapshots are double buffered, and a writer thread compresses each one, in
+// blocks of agents, in parallel, and writes out the chunks, while the next
+// iteration runs. So only two snapshots are kept beside the compressed
+// streams, and the simulation only waits if the writer falls behind.
+
+#define HIST_MAGIC 0x68736d64
+#define HIST_VERSION 2
+
+#define HIST_MONEY 0
+#define HIST_PRICE 1
+#define HIST_CSMP 2
+#define HIST_UNSOLD_PROD 3
+#define HIST_NUM_FIELDS 4
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int num_ags;
+    int window;
+    int num_fields;
+    // mantissa bits kept in the values, 52 when they are lossless
+    int mantissa_bits;
+} hist_hdr_t;
+
+typedef struct {
+    int first_iter;
+    int num_iters;
+    // size of the streams that follow the offsets table
+    uint64_t data_size;
+} hist_chunk_hdr_t;
+
+// mantissa_bits of each value are kept, rounding off the rest, which makes
+// the values repeat more often and so compress better; 52 is lossless
+void hist_open(const char* fname, int num_ags, int window, int mantissa_bits);
+// records the current state of all the agents, which is compressed, and
+// written out in a chunk every window iterations, by the writer thread
+void hist_record(int iter, ag_t* ags);
+void hist_close(void);
+
+// reads the history of a single agent into vals, HIST_NUM_FIELDS values per
+// iteration, and returns the number of iterations read; mantissa_bits is set
+// to the bits kept in the values
+int hist_read_ag(const char* fname, int ag_id, double** vals, int* mantissa_bits);
+
+#endif
@@ -0,0 +1,120 @@
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "utils.h"
+#include "dismal.h"
+#include "mobility.h"
+
+typedef struct {
+    amt_t wealth;
+    int id;
+} mob_rank_t;
+
+static struct {
+    mob_rank_t* _;
+    int num;
+    int num_bands;
+    // the ranks and bands at this report and at the last one
+    double* ranks;
+    double* prev_ranks;
+    unsigned char* bands;
+    unsigned char* prev_bands;
+    int have_prev;
+    // transitions from the band at the last report to the band now
+    long* trans;
+} _mob;
+
+static int cmp_wealth(const void* a, const void* b) {
+    amt_t wa = ((const mob_rank_t*)a)->wealth;
+    amt_t wb = ((const mob_rank_t*)b)->wealth;
+    return (wa > wb) - (wa < wb);
+}
+
+void init_mobility(void) {
+    _mob.num = _ags.num;
+    _mob.num_bands = _cfg.mobility_bands;
+    _mob._ = malloc(_mob.num * sizeof(mob_rank_t));
+    _mob.ranks = malloc(_mob.num * sizeof(double));
+    _mob.prev_ranks = malloc(_mob.num * sizeof(double));
+    _mob.bands = malloc(_mob.num);
+    _mob.prev_bands = malloc(_mob.num);
+    _mob.trans = malloc(_mob.num_bands * _mob.num_bands * sizeof(long));
+    _mob.have_prev = 0;
+}
+
+static int get_band(int rank) {
+    int band = (long)rank * _mob.num_bands / _mob.num;
+    return band < _mob.num_bands ? band : _mob.num_bands - 1;
+}
+
+void report_mobility(int t) {
+    int n = _mob.num;
+    // the wealth is sorted with the ids alongside, rather than sorting the ids
+    // by looking up the agents, so the sort doesn't jump around the agents
+    long num_poor = 0, tot_spell = 0, tot_max_spell = 0;
+    int max_spell = 0;
+    for (int i = 0; i < n; i++) {
+        ag_t* ag = &_ags._[i];
+        _mob._[i].wealth = ag->money + ag->money_gained;
+        _mob._[i].id = i;
+        num_poor += ag->pvt_spell > 0;
+        tot_spell += ag->pvt_spell;
+        tot_max_spell += ag->max_pvt_spell;
+        if (max_spell < ag->max_pvt_spell) max_spell = ag->max_pvt_spell;
+    }
+    qsort(_mob._, n, sizeof(mob_rank_t), cmp_wealth);
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && _mob._[j].wealth == _mob._[i].wealth) j++;
+        // tied agents all go in the band of the lowest of their ranks, so
+        // that, e.g., agents with no money are always in the bottom band
+        double rank = (i + j - 1) / 2.0;
+        int band = get_band(i);
+        for (int k = i; k < j; k++) {
+            _mob.ranks[_mob._[k].id] = rank;
+            _mob.bands[_mob._[k].id] = band;
+        }
+        i = j;
+    }
+
+    printf(" MOBILITY %d: poor %.1f%%, spell av %.1f, longest av %.1f mx %d",
+           t, (double)num_poor * 100.0 / n, num_poor ? (double)tot_spell / num_poor : 0.0,
+           (double)tot_max_spell / n, max_spell);
+    if (_mob.have_prev) {
+        // Spearman correlation is the correlation of the ranks, whose mean is
+        // the same at every report
+        double mean = (n - 1) / 2.0;
+        double cov = 0, var = 0, prev_var = 0;
+        for (int b = 0; b < _mob.num_bands * _mob.num_bands; b++) _mob.trans[b] = 0;
+        for (int i = 0; i < n; i++) {
+            double d = _mob.ranks[i] - mean;
+            double prev_d = _mob.prev_ranks[i] - mean;
+            cov += d * prev_d;
+            var += d * d;
+            prev_var += prev_d * prev_d;
+            _mob.trans[_mob.prev_bands[i] * _mob.num_bands + _mob.bands[i]]++;
+        }
+        printf(", rank corr %.3f\n", var && prev_var ? cov / sqrt(var * prev_var) : 1.0);
+        // each row is the percentage of a band at the last report that ended
+        // up in each band
+        for (int b = 0; b < _mob.num_bands; b++) {
+            long* row = &_mob.trans[b * _mob.num_bands];
+            long row_tot = 0;
+            for (int c = 0; c < _mob.num_bands; c++) row_tot += row[c];
+            printf("   band %2d:", b + 1);
+            for (int c = 0; c < _mob.num_bands; c++) {
+                printf("%7.1f", row_tot ? (double)row[c] * 100.0 / row_tot : 0.0);
+            }
+            printf("\n");
+        }
+    } else {
+        printf("\n");
+    }
+    double* tmp = _mob.prev_ranks;
+    _mob.prev_ranks = _mob.ranks;
+    _mob.ranks = tmp;
+    unsigned char* tmp_bands = _mob.prev_bands;
+    _mob.prev_bands = _mob.bands;
+    _mob.bands = tmp_bands;
+    _mob.have_prev = 1;
+}
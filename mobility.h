@@ -0,0 +1,19 @@
+#ifndef _MOBILITY_H
+#define _MOBILITY_H
+
+// Mobility reports: at the stats cadence, the agents are ranked by wealth
+// (money plus the gains not yet realized), with tied agents given the average
+// of their ranks, and split into mobility_bands equal bands by rank; tied
+// agents all go in the lowest band they span. Each report gives the matrix
+// of transitions between the bands since the last report, the Spearman rank
+// correlation of wealth with the last report, and the lengths of the poverty
+// spells.
+//
+// The poverty spell counters are kept in the agents, and updated in the sweeps
+// that already go over all the agents every iteration (see
+// update_pvt_spell()), so only the reports cost a pass of their own.
+
+void init_mobility(void);
+void report_mobility(int t);
+
+#endif
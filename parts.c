@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+// forked partitions need process-shared barriers and PR_SET_PDEATHSIG, which
+// are only there on Linux
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include "utils.h"
+#include "dismal.h"
+#include "parts.h"
+
+typedef struct {
+    // the agents owned are [first, last)
+    int first;
+    int last;
+    unsigned int rnd_seed;
+    // the active consumers and producers are at the start of this
+    // partition's slice of the shared lists
+    int num_csmrs;
+    int num_prdrs;
+    int num_reqs;
+    long num_trades;
+} part_t;
+
+// everything here is in shared memory when the partitions are forked
+static struct {
+    part_t* _;
+    int num;
+    int size;
+    int* csmrs;
+    int* prdrs;
+    // each partition's requests are in its slice, bucketed by the partition
+    // that owns the producer; req_offsets has num + 1 entries per partition
+    trade_req_t* reqs;
+    int* req_offsets;
+#ifdef __linux__
+    pthread_barrier_t* barrier;
+#endif
+} _parts;
+
+// the partition run by this process, or -1 when running all of them
+static int _my_part = -1;
+static pid_t* _pids;
+
+// scratch space for bucketing requests, private to each process
+static trade_req_t* _scratch_reqs;
+static int* _scratch_dsts;
+
+void* alloc_shared(size_t size) {
+    // an empty mapping is an error, but there may be no agents
+    if (!size) size = 1;
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                     -1, 0);
+    if (ptr == MAP_FAILED) {
+        FAIL("Could not map %lu bytes of shared memory\n", (unsigned long)size);
+    }
+    return ptr;
+}
+
+static void* alloc_parts(size_t size) {
+    if (_cfg.fork_parts) return alloc_shared(size);
+    return calloc(1, size);
+}
+
+void init_parts(void) {
+    _parts.num = _cfg.num_parts;
+    if (_parts.num > _ags.num) _parts.num = _ags.num;
+    // with no agents, there is still one (empty) partition
+    if (_parts.num < 1) _parts.num = 1;
+    _parts.size = (_ags.num + _parts.num - 1) / _parts.num;
+    _parts._ = alloc_parts(_parts.num * sizeof(part_t));
+    _parts.csmrs = alloc_parts(_ags.num * sizeof(int));
+    _parts.prdrs = alloc_parts(_ags.num * sizeof(int));
+    _parts.reqs = alloc_parts(_ags.num * sizeof(trade_req_t));
+    _parts.req_offsets = alloc_parts(_parts.num * (_parts.num + 1) * sizeof(int));
+    for (int p = 0; p < _parts.num; p++) {
+        part_t* part = &_parts._[p];
+        part->first = p * _parts.size;
+        part->last = part->first + _parts.size;
+        if (part->last > _ags.num) part->last = _ags.num;
+        if (part->first > _ags.num) part->first = _ags.num;
+        part->rnd_seed = get_stream_seed(_cfg.rseed, p);
+    }
+    _scratch_reqs = malloc(_parts.size * sizeof(trade_req_t));
+    _scratch_dsts = malloc(_parts.size * sizeof(int));
+    if (_cfg.fork_parts) {
+#ifdef __linux__
+        _parts.barrier = alloc_shared(sizeof(pthread_barrier_t));
+        pthread_barrierattr_t attr;
+        pthread_barrierattr_init(&attr);
+        pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_barrier_init(_parts.barrier, &attr, _parts.num);
+        pthread_barrierattr_destroy(&attr);
+#else
+        FAIL("Forked partitions are only supported on Linux: %d\n", _cfg.fork_parts);
+#endif
+    }
+}
+
+// Runs a step for this process's partition and waits for all the others, or
+// runs the step for every partition in turn. Each partition has its own
+// random stream, which is swapped in while its step runs. With no step, just
+// waits for the others.
+static void run_step(void (*step)(int p)) {
+    for (int p = 0; step && p < _parts.num; p++) {
+        if (_my_part != -1 && p != _my_part) continue;
+        part_t* part = &_parts._[p];
+        unsigned int seed = swap_rnd_seed(part->rnd_seed);
+        step(p);
+        part->rnd_seed = swap_rnd_seed(seed);
+    }
+#ifdef __linux__
+    if (_my_part != -1) pthread_barrier_wait(_parts.barrier);
+#endif
+}
+
+static void update_step(int p) {
+    part_t* part = &_parts._[p];
+    part->num_csmrs = 0;
+    part->num_prdrs = 0;
+    part->num_trades = 0;
+    for (int i = part->first; i < part->last; i++) {
+        ag_t* ag = &_ags._[i];
+        ag->csmp = 0;
+        if (ag->money > 0) _parts.csmrs[part->first + part->num_csmrs++] = i;
+        ag->unsold_prod = ag->max_prod;
+        if (ag->unsold_prod > 0) _parts.prdrs[part->first + part->num_prdrs++] = i;
+        ag->money += ag->money_gained;
+        ag->money_gained = 0;
+    }
+}
+
+// picks a producer uniformly from the active producers of all partitions
+static int get_rnd_prdr(int tot_prdrs) {
+    int prdr_i = get_int_rnd(tot_prdrs);
+    for (int q = 0; q < _parts.num; q++) {
+        part_t* part = &_parts._[q];
+        if (prdr_i < part->num_prdrs) return _parts.prdrs[part->first + prdr_i];
+        prdr_i -= part->num_prdrs;
+    }
+    return -1;
+}
+
+static void request_step(int p) {
+    part_t* part = &_parts._[p];
+    int tot_prdrs = 0;
+    for (int q = 0; q < _parts.num; q++) tot_prdrs += _parts._[q].num_prdrs;
+    int* offsets = &_parts.req_offsets[p * (_parts.num + 1)];
+    memset(offsets, 0, (_parts.num + 1) * sizeof(int));
+    part->num_reqs = 0;
+    if (!tot_prdrs) return;
+    // the producers are only read here, so any partition's can be sampled
+    for (int i = 0; i < part->num_csmrs; i++) {
+        ag_t* csmr = &_ags._[_parts.csmrs[part->first + i]];
+        int prdr_id = -1;
+        double min_price = 1e9;
+        for (int j = 0; j < _cfg.prdr_sample_size; j++) {
+            int id = get_rnd_prdr(tot_prdrs);
+            if (id == csmr->id) continue;
+            if (_ags._[id].prod_price < min_price) {
+                min_price = _ags._[id].prod_price;
+                prdr_id = id;
+            }
+        }
+        if (prdr_id == -1) continue;
+        trade_req_t* req = &_scratch_reqs[part->num_reqs];
+        req->csmr_id = csmr->id;
+        req->csmr_i = i;
+        req->prdr_id = prdr_id;
+        req->wanted = csmr->max_csmp - csmr->csmp;
+        req->money = csmr->money;
+        _scratch_dsts[part->num_reqs++] = prdr_id / _parts.size;
+        offsets[prdr_id / _parts.size + 1]++;
+    }
+    // bucket the requests by destination partition
+    for (int q = 0; q < _parts.num; q++) offsets[q + 1] += offsets[q];
+    int fill[_parts.num];
+    memcpy(fill, offsets, _parts.num * sizeof(int));
+    for (int i = 0; i < part->num_reqs; i++) {
+        _parts.reqs[part->first + fill[_scratch_dsts[i]]++] = _scratch_reqs[i];
+    }
+}
+
+static void grant_step(int p) {
+    part_t* part = &_parts._[p];
+    // requests are granted in a fixed order, by source partition and then in
+    // the order they were made
+    for (int q = 0; q < _parts.num; q++) {
+        part_t* src = &_parts._[q];
+        int* offsets = &_parts.req_offsets[q * (_parts.num + 1)];
+        for (int i = offsets[p]; i < offsets[p + 1]; i++) {
+            trade_req_t* req = &_parts.reqs[src->first + i];
+            ag_t* prdr = &_ags._[req->prdr_id];
+            req->done = 0;
+            if (prdr->unsold_prod == 0) {
+                // sold out to an earlier request in this sub-round
+                req->csmp = req->cost = 0;
+                continue;
+            }
+            get_trade(req->wanted, req->money, prdr->unsold_prod, prdr->prod_price,
+                      &req->csmp, &req->cost);
+            if (req->csmp == 0) req->done = 1;
+            prdr->unsold_prod -= req->csmp;
+            CLAMP_ROUND_OFF(prdr->unsold_prod);
+            prdr->tot_prod += req->csmp;
+            prdr->money_gained += req->cost;
+            if (req->csmp) part->num_trades++;
+        }
+    }
+    int num = 0;
+    for (int i = 0; i < part->num_prdrs; i++) {
+        int id = _parts.prdrs[part->first + i];
+        if (_ags._[id].unsold_prod > 0) _parts.prdrs[part->first + num++] = id;
+    }
+    part->num_prdrs = num;
+}
+
+static void apply_step(int p) {
+    part_t* part = &_parts._[p];
+    for (int i = 0; i < part->num_reqs; i++) {
+        trade_req_t* req = &_parts.reqs[part->first + i];
+        ag_t* csmr = &_ags._[req->csmr_id];
+        csmr->money -= req->cost;
+        CLAMP_ROUND_OFF(csmr->money);
+        csmr->csmp += req->csmp;
+        csmr->tot_csmp += req->csmp;
+        // a consumer that can't afford even the smallest amount is done
+        if (req->done) _parts.csmrs[part->first + req->csmr_i] = -1;
+    }
+    int num = 0;
+    for (int i = 0; i < part->num_csmrs; i++) {
+        int id = _parts.csmrs[part->first + i];
+        if (id == -1) continue;
+        ag_t* csmr = &_ags._[id];
+        if (csmr->money == 0 || csmr->csmp >= csmr->max_csmp) continue;
+        _parts.csmrs[part->first + num++] = id;
+    }
+    part->num_csmrs = num;
+}
+
+static void price_step(int p) {
+    part_t* part = &_parts._[p];
+    for (int i = part->first; i < part->last; i++) {
+        compute_price(&_ags._[i]);
+        update_pvt_spell(&_ags._[i]);
+    }
+}
+
+long clear_parts(void) {
+    // wait for the first partition to finish with the stats and shocks
+    run_step(NULL);
+    run_step(update_step);
+    while (1) {
+        run_step(request_step);
+        // every worker sees the same counts, so they all stop together
+        int tot_reqs = 0;
+        for (int q = 0; q < _parts.num; q++) tot_reqs += _parts._[q].num_reqs;
+        if (!tot_reqs) break;
+        run_step(grant_step);
+        run_step(apply_step);
+    }
+    run_step(price_step);
+    long num_trades = 0;
+    for (int q = 0; q < _parts.num; q++) num_trades += _parts._[q].num_trades;
+    return num_trades;
+}
+
+#ifdef __linux__
+// A worker that fails would leave all the others waiting at the barrier for
+// ever, so when one exits with an error, or is killed, the rest are killed
+// too. Only async-signal-safe calls are made here.
+static void on_worker_exit(int sig) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+        const char msg[] = "A partition worker failed, stopping\n";
+        if (write(STDERR_FILENO, msg, sizeof(msg) - 1)) {}
+        for (int p = 1; p < _parts.num; p++) {
+            if (_pids[p] != pid) kill(_pids[p], SIGKILL);
+        }
+        _exit(-1);
+    }
+}
+
+void start_parts(void) {
+    if (!_cfg.fork_parts) return;
+    _pids = calloc(_parts.num, sizeof(pid_t));
+    signal(SIGCHLD, on_worker_exit);
+    for (int p = 1; p < _parts.num; p++) {
+        _pids[p] = fork();
+        if (_pids[p] == -1) {
+            FAIL("Could not fork worker for partition %d\n", p);
+        }
+        if (_pids[p] == 0) {
+            // and the workers are killed if the first partition fails
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() == 1) _exit(-1);
+            _my_part = p;
+            for (_iters = 0; _iters < _cfg.num_iters; _iters++) clear_parts();
+            _exit(0);
+        }
+    }
+    _my_part = 0;
+}
+
+void stop_parts(void) {
+    if (!_cfg.fork_parts) return;
+    // the workers finish normally from here on
+    signal(SIGCHLD, SIG_DFL);
+    for (int p = 1; p < _parts.num; p++) waitpid(_pids[p], NULL, 0);
+}
+
+#else
+
+// init_parts() has already refused fork_parts, so there is nothing to start
+void start_parts(void) {
+}
+
+void stop_parts(void) {
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _PARTS_H
+#define _PARTS_H
+
+#include <stddef.h>
+#include "amt.h"
+
+// Partitioned mode: the agents are split into num_parts contiguous
+// partitions, each of which is owned by one worker. A worker only ever writes
+// to its own agents. Trading across partitions is done in sub-rounds, with
+// all the communication for a sub-round batched together:
+//
+//   1. each worker's consumers sample producers from all partitions, and
+//      write one trade request each, bucketed by the partition that owns the
+//      producer
+//   2. each worker grants the requests for its own producers, in a fixed
+//      order, and records what each consumer gets and pays
+//   3. each worker applies the grants to its own consumers
+//
+// until no consumer can trade any more. With fork_parts (Linux only), each
+// partition is run by its own process, and the agents, the lists and the
+// requests all live in shared memory, with a process-shared barrier between
+// the steps, and if any of the processes fails, they are all stopped. Without
+// it, the same steps are run for each partition in turn in a single process,
+// which gives exactly the same results, and is a stand-in for testing.
+
+typedef struct {
+    int csmr_id;
+    // where the consumer is in its partition's list of consumers
+    int csmr_i;
+    int prdr_id;
+    // how much the consumer wants, and the money it can spend
+    amt_t wanted;
+    amt_t money;
+    // what the producer's owner granted
+    amt_t csmp;
+    amt_t cost;
+    // set if the consumer can't afford anything from the producer
+    int done;
+} trade_req_t;
+
+void* alloc_shared(size_t size);
+void init_parts(void);
+// forks the workers for partitions other than the first; the caller carries
+// on as the worker for the first partition
+void start_parts(void);
+void stop_parts(void);
+// runs a single round of updating, clearing and pricing for all partitions,
+// and returns the number of trades
+long clear_parts(void);
+
+#endif
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "shocks.h"
+
+static int cmp_shocks(const void* p1, const void* p2) {
+    const shock_t* s1 = p1;
+    const shock_t* s2 = p2;
+    if (s1->iter != s2->iter) return s1->iter < s2->iter ? -1 : 1;
+    return s1->line_num - s2->line_num;
+}
+
+static int get_shock_type(const char* name) {
+    int num_types = sizeof(SHOCK_TYPES) / sizeof(shock_type_t);
+    for (int i = 0; i < num_types; i++) {
+        if (!strcmp(name, SHOCK_TYPES[i].name)) return SHOCK_TYPES[i].index;
+    }
+    return -1;
+}
+
+void load_shocks(const char* fname, shocks_t* shocks) {
+    shocks->num = 0;
+    shocks->next = 0;
+    shocks->_ = NULL;
+    FILE* f = fopen(fname, "r");
+    if (!f) {
+        FAIL("Could not open shocks file %s\n", fname);
+    }
+    int max_num = 0;
+    char line[1000];
+    int line_num = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_num++;
+        char* start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0') continue;
+        shock_t shock = {.line_num = line_num};
+        char type_name[100];
+        if (sscanf(start, "%d %99s %d %d %lf", &shock.iter, type_name,
+                   &shock.first_ag, &shock.last_ag, &shock.value) != 5) {
+            FAIL("Badly formed shock in %s at line %d\n", fname, line_num);
+        }
+        shock.type = get_shock_type(type_name);
+        if (shock.type == -1) {
+            FAIL("Unknown shock type '%s' in %s at line %d\n", type_name, fname,
+                 line_num);
+        }
+        if (shock.iter < 0 || shock.first_ag < 0 ||
+            (shock.last_ag != -1 && shock.last_ag < shock.first_ag)) {
+            FAIL("Invalid iteration or agent range in %s at line %d\n", fname,
+                 line_num);
+        }
+        // a scale of 0 shuts capacity down, but a negative one is meaningless
+        if ((shock.type == SHOCK_CSMP || shock.type == SHOCK_PROD) && shock.value < 0) {
+            FAIL("Negative scale %.3f in %s at line %d\n", shock.value, fname, line_num);
+        }
+        if (shocks->num == max_num) {
+            max_num = max_num ? max_num * 2 : 16;
+            shocks->_ = realloc(shocks->_, max_num * sizeof(shock_t));
+        }
+        shocks->_[shocks->num++] = shock;
+    }
+    fclose(f);
+    // sorted by iteration, so only the next shock ever needs to be checked
+    qsort(shocks->_, shocks->num, sizeof(shock_t), cmp_shocks);
+}
+
+void print_shock(shock_t* shock, FILE* f) {
+    fprintf(f, "shock at %d: %s on agents [%d, %d) value %.3f\n", shock->iter,
+            SHOCK_TYPES[shock->type].name, shock->first_ag, shock->last_ag,
+            shock->value);
+}
@@ -0,0 +1,59 @@
+#ifndef _SHOCKS_H
+#define _SHOCKS_H
+
+#include <stdio.h>
+
+// A scenario timeline of shocks that are applied to the economy at fixed
+// iterations. The timeline is read from a text file at startup, where each
+// non-comment line has the form:
+//
+//     <iter> <type> <first_ag> <last_ag> <value>
+//
+// The shock is applied to the agents in the range [first_ag, last_ag); a
+// last_ag of -1 means all agents from first_ag onwards.
+
+#define SHOCK_MONEY 0
+#define SHOCK_CSMP 1
+#define SHOCK_PROD 2
+#define SHOCK_PRICE_ADJUST 3
+
+typedef struct {
+    int index;
+    char* name;
+    char* descr;
+} shock_type_t;
+
+static const shock_type_t SHOCK_TYPES[] = {
+    {.index = SHOCK_MONEY, .name = "money",
+     .descr = "add money to each agent (negative removes it)"},
+    {.index = SHOCK_CSMP, .name = "csmp",
+     .descr = "scale max. consumption by value (>= 0)"},
+    {.index = SHOCK_PROD, .name = "prod",
+     .descr = "scale max. production by value (>= 0)"},
+    {.index = SHOCK_PRICE_ADJUST, .name = "price_adjust",
+     .descr = "set the price adjustment to value"},
+};
+
+typedef struct {
+    int iter;
+    int type;
+    int first_ag;
+    int last_ag;
+    double value;
+    // position in the file, so that shocks at the same iteration are applied
+    // in the order they were given
+    int line_num;
+} shock_t;
+
+typedef struct {
+    shock_t* _;
+    int num;
+    // the next shock to be applied; the timeline is sorted by iteration so
+    // the main loop only ever needs to check this one
+    int next;
+} shocks_t;
+
+void load_shocks(const char* fname, shocks_t* shocks);
+void print_shock(shock_t* shock, FILE* f);
+
+#endif
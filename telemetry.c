@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utils.h"
+#include "telemetry.h"
+
+static tl_ring_t* _ring = NULL;
+static const char* _ring_name = NULL;
+
+static size_t get_ring_size(int num_slots) {
+    return sizeof(tl_ring_t) + num_slots * sizeof(tl_slot_t);
+}
+
+void tl_open(const char* name, int num_ags, int num_iters) {
+    size_t size = get_ring_size(TL_NUM_SLOTS);
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) {
+        FAIL("Could not open shared memory %s for telemetry\n", name);
+    }
+    if (ftruncate(fd, size) == -1) {
+        FAIL("Could not size shared memory %s for telemetry\n", name);
+    }
+    _ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_ring == MAP_FAILED) {
+        FAIL("Could not map shared memory %s for telemetry\n", name);
+    }
+    _ring_name = name;
+    _ring->version = TL_VERSION;
+    _ring->num_slots = TL_NUM_SLOTS;
+    _ring->num_ags = num_ags;
+    _ring->num_iters = num_iters;
+    _ring->pid = getpid();
+    _ring->done = 0;
+    _ring->head = 0;
+    // readers check the magic number last, so it must be written last
+    __atomic_store_n(&_ring->magic, TL_MAGIC, __ATOMIC_RELEASE);
+}
+
+void tl_close(void) {
+    if (!_ring) return;
+    __atomic_store_n(&_ring->done, 1, __ATOMIC_RELEASE);
+    munmap(_ring, get_ring_size(TL_NUM_SLOTS));
+    // readers that are already attached keep their mapping
+    shm_unlink(_ring_name);
+    _ring = NULL;
+}
+
+void tl_publish(tl_rec_t* rec) {
+    if (!_ring) return;
+    rec->av_money /= _ring->num_ags;
+    rec->av_price /= _ring->num_ags;
+    rec->av_csmp /= _ring->num_ags;
+    rec->av_prod /= _ring->num_ags;
+    uint64_t head = _ring->head;
+    tl_slot_t* slot = &_ring->slots[head % _ring->num_slots];
+    // there is only one writer, so a plain increment of the sequence number
+    // is enough; the fence keeps the record writes after it
+    uint32_t seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->rec_i = head;
+    slot->rec = *rec;
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&_ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+tl_ring_t* tl_attach(const char* name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < sizeof(tl_ring_t)) {
+        close(fd);
+        return NULL;
+    }
+    tl_ring_t* ring = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) return NULL;
+    if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != TL_MAGIC ||
+        ring->version != TL_VERSION ||
+        st.st_size < get_ring_size(ring->num_slots)) {
+        munmap(ring, st.st_size);
+        return NULL;
+    }
+    return ring;
+}
+
+int tl_read(tl_ring_t* ring, uint64_t rec_i, tl_rec_t* rec) {
+    tl_slot_t* slot = &ring->slots[rec_i % ring->num_slots];
+    while (1) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (rec_i >= head || head - rec_i > ring->num_slots) return 0;
+        uint32_t seq1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq1 & 1) continue;
+        uint64_t slot_rec_i = slot->rec_i;
+        *rec = slot->rec;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if (seq1 != seq2) continue;
+        // the slot may already have been reused for a later record
+        return slot_rec_i == rec_i;
+    }
+}
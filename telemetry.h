@@ -0,0 +1,80 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <stdint.h>
+#include "amt.h"
+
+// Live telemetry: the simulation publishes the aggregates for an iteration
+// into a ring buffer in POSIX shared memory, which a separate process (see
+// dismal_top.c) can attach to and read while the simulation runs.
+//
+// Working out the aggregates takes a pass over all the agents, so rather than
+// every iteration, they are published when at least TL_PUBLISH_SECS have gone
+// by since the last time, and for the last iteration. Apart from that, the
+// cost is two clock reads per iteration, for the timing.
+//
+// There is a single writer, which never waits for readers: each slot is
+// protected by a sequence number that is odd while the slot is being written,
+// so a reader copies a slot and then checks that the sequence number is even
+// and unchanged. If the reader falls more than a ring's worth of records
+// behind, it simply loses the oldest ones.
+
+#define TL_MAGIC 0x64736d6c
+#define TL_VERSION 2
+#define TL_NUM_SLOTS 4096
+#define TL_PUBLISH_SECS 1.0
+
+typedef struct {
+    int iter;
+    double av_money;
+    double max_money;
+    double min_money;
+    double av_price;
+    double max_price;
+    double min_price;
+    double av_csmp;
+    double max_csmp;
+    double min_csmp;
+    double av_prod;
+    double max_prod;
+    double min_prod;
+    int num_in_poverty;
+    int64_t num_trades;
+    // wall clock time in seconds for the clearing and for the whole iteration
+    double clear_time;
+    double iter_time;
+} tl_rec_t;
+
+typedef struct {
+    uint32_t seq;
+    // the number of the record held in this slot
+    uint64_t rec_i;
+    tl_rec_t rec;
+} __attribute__((aligned(64))) tl_slot_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int num_slots;
+    int num_ags;
+    int num_iters;
+    // the writer's process, so readers can tell if it died
+    int pid;
+    // set when the simulation has finished
+    int done;
+    // total number of records written so far
+    uint64_t head __attribute__((aligned(64)));
+    tl_slot_t slots[];
+} tl_ring_t;
+
+void tl_open(const char* name, int num_ags, int num_iters);
+void tl_close(void);
+// the averages in rec are passed as sums over the agents
+void tl_publish(tl_rec_t* rec);
+
+// attaches to the ring for reading; returns NULL if it doesn't exist yet
+tl_ring_t* tl_attach(const char* name);
+// copies record number rec_i into rec; returns 0 if it has been overwritten
+int tl_read(tl_ring_t* ring, uint64_t rec_i, tl_rec_t* rec);
+
+#endif
@@ -1,9 +1,11 @@
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #define _GNU_SOURCE
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <sys/time.h>
 #include <stdarg.h>
@@ -11,6 +13,8 @@
 
 #include "utils.h"
 
+char* _timer_names[MAX_TIMERS];
+
 static unsigned int _rnd_seed = 29;
 static double _elapsed_time[MAX_TIMERS];
 static double _start_time[MAX_TIMERS];
@@ -19,11 +23,57 @@ void init_rnd(unsigned int rseed) {
     _rnd_seed = rseed;
 }
 
+// sets the random state and returns the previous one, so that several
+// streams can take turns with the functions below
+unsigned int swap_rnd_seed(unsigned int rseed) {
+    unsigned int prev_seed = _rnd_seed;
+    _rnd_seed = rseed;
+    return prev_seed;
+}
+
+// Derives the seed for one of many streams. Seeds that are close together give
+// closely related first draws from rand_r, so they are scrambled first.
+unsigned int get_stream_seed(unsigned int rseed, unsigned int stream) {
+    uint64_t x = ((uint64_t)rseed << 32 | stream) + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (x ^ (x >> 31)) >> 32;
+}
+
+#ifdef __GLIBC__
+// Returns the state after num_draws more draws from seed. This relies on
+// rand_r being the glibc one, which takes three steps of a 32-bit linear
+// congruential generator per draw, and so can be jumped ahead in log time
+// by composing the steps.
+unsigned int skip_rnd_seed(unsigned int seed, unsigned long num_draws) {
+    unsigned int mul = 1103515245;
+    unsigned int add = 12345;
+    unsigned long num_steps = num_draws * 3;
+    while (num_steps) {
+        if (num_steps & 1) seed = seed * mul + add;
+        add = add * mul + add;
+        mul = mul * mul;
+        num_steps >>= 1;
+    }
+    return seed;
+}
+#endif
+
 int get_int_rnd(int range) {
+    return get_int_rnd_r(range, &_rnd_seed);
+}
+
+double get_double_rnd(double min, double max) {
+    return get_double_rnd_r(min, max, &_rnd_seed);
+}
+
+// These versions take their own random state, so that independent streams
+// can be used concurrently, e.g. one per good
+int get_int_rnd_r(int range, unsigned int* seed) {
     if (range <= 0) {
         FAIL("Range for get_int_rnd <= 0: %d\n", range);
     }
-    int rnd_index = ((double)range * rand_r(&_rnd_seed)) / RAND_MAX;
+    int rnd_index = ((double)range * rand_r(seed)) / RAND_MAX;
     if (rnd_index > range - 1 || rnd_index < 0) {
         FAIL("Error in random number generation index out of range, %d > %d\n", 
              rnd_index, range - 1);
@@ -31,8 +81,29 @@ int get_int_rnd(int range) {
     return rnd_index;
 }
 
-double get_double_rnd(double min, double max) {
-    return ((double)rand_r(&_rnd_seed)) / (double)RAND_MAX * (max - min) + min;
+double get_double_rnd_r(double min, double max, unsigned int* seed) {
+    return ((double)rand_r(seed)) / (double)RAND_MAX * (max - min) + min;
+}
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+void* alloc_huge(size_t size, int shared) {
+#ifdef __linux__
+    size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    int flags = (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS;
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) return ptr;
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (ptr == MAP_FAILED) {
+        FAIL("Could not map %lu bytes for huge pages\n", (unsigned long)size);
+    }
+    madvise(ptr, size, MADV_HUGEPAGE);
+    return ptr;
+#else
+    // huge pages are only asked for on Linux, and the memory is only shared
+    // with forked partitions, which are Linux only too
+    return calloc(1, size);
+#endif
 }
 
 double _get_current_time(void) {
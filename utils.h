@@ -3,9 +3,10 @@
 
 #include <sys/syscall.h>
 #include <stdio.h>
+#include <stddef.h>
 
 #define MAX_TIMERS 20
-char* _timer_names[MAX_TIMERS];
+extern char* _timer_names[MAX_TIMERS];
 
 #ifdef __APPLE__
 #define CREATE_TIMER(t, index) static int t = index
@@ -18,8 +19,20 @@ char* _timer_names[MAX_TIMERS];
       exit(-1);} while (0);
 
 void init_rnd(unsigned int rseed);
+unsigned int swap_rnd_seed(unsigned int rseed);
+unsigned int get_stream_seed(unsigned int rseed, unsigned int stream);
+#ifdef __GLIBC__
+// only with glibc, whose rand_r is known
+unsigned int skip_rnd_seed(unsigned int seed, unsigned long num_draws);
+#endif
 int get_int_rnd(int range);
 double get_double_rnd(double min, double max);
+int get_int_rnd_r(int range, unsigned int* seed);
+double get_double_rnd_r(double min, double max, unsigned int* seed);
+// on Linux, maps memory backed by huge pages if any are reserved, otherwise
+// asks for transparent huge pages, and elsewhere just allocates it; the
+// memory is zeroed, and shared with forked processes if shared is set
+void* alloc_huge(size_t size, int shared);
 double _get_current_time(void);
 void timer_clear(int n);
 void timer_start(int n);